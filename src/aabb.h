@@ -0,0 +1,115 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "interval.h"
+#include "ray.h"
+#include "vec3.h"
+
+/* Axis-aligned bounding box, one interval per axis */
+class aabb
+{
+public:
+    interval x, y, z;
+
+    /* The default box is empty, since intervals are empty by default */
+    aabb() {}
+
+    aabb( const interval& x, const interval& y, const interval& z )
+        : x( x ), y( y ), z( z )
+    {
+        pad_to_minimums();
+    }
+
+    /* Treat «a» and «b» as extrema of the box, in any order */
+    aabb( const point3& a, const point3& b )
+    {
+        x = ( a[0] <= b[0] ) ? interval( a[0], b[0] ) : interval( b[0], a[0] );
+        y = ( a[1] <= b[1] ) ? interval( a[1], b[1] ) : interval( b[1], a[1] );
+        z = ( a[2] <= b[2] ) ? interval( a[2], b[2] ) : interval( b[2], a[2] );
+
+        pad_to_minimums();
+    }
+
+    aabb( const aabb& box_0, const aabb& box_1 )
+    {
+        x = interval( box_0.x, box_1.x );
+        y = interval( box_0.y, box_1.y );
+        z = interval( box_0.z, box_1.z );
+    }
+
+    const interval& axis_interval( int n ) const
+    {
+        if ( n == 1 ) { return y; }
+        if ( n == 2 ) { return z; }
+
+        return x;
+    }
+
+    bool hit( const ray& r, interval ray_t ) const
+    {
+        const point3& ray_orig = r.origin();
+        const vec3&   ray_dir  = r.direction();
+
+        for ( int axis = 0; axis < 3; ++axis ) {
+            const interval& ax    = axis_interval( axis );
+            const double    adinv = 1.0 / ray_dir[axis];
+
+            auto t_0 = ( ax.min - ray_orig[axis] ) * adinv;
+            auto t_1 = ( ax.max - ray_orig[axis] ) * adinv;
+
+            if ( t_0 < t_1 ) {
+                if ( t_0 > ray_t.min ) { ray_t.min = t_0; }
+                if ( t_1 < ray_t.max ) { ray_t.max = t_1; }
+            } else {
+                if ( t_1 > ray_t.min ) { ray_t.min = t_1; }
+                if ( t_0 < ray_t.max ) { ray_t.max = t_0; }
+            }
+
+            if ( ray_t.max <= ray_t.min ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /* Index of the axis along which the box is the longest */
+    int longest_axis( void ) const
+    {
+        if ( x.size() > y.size() ) {
+            return x.size() > z.size() ? 0 : 2;
+        }
+
+        return y.size() > z.size() ? 1 : 2;
+    }
+
+    double surface_area( void ) const
+    {
+        if ( x.size() < 0 || y.size() < 0 || z.size() < 0 ) { return 0; }
+
+        return 2 * ( ( x.size() * y.size() ) + ( y.size() * z.size() ) + ( z.size() * x.size() ) );
+    }
+
+    point3 centroid( void ) const
+    {
+        return point3( 0.5 * ( x.min + x.max ), 0.5 * ( y.min + y.max ), 0.5 * ( z.min + z.max ) );
+    }
+
+    static const aabb empty, universe;
+
+private:
+    /* Keep every side at least «delta» wide, so that flat boxes still get hit */
+    void pad_to_minimums( void )
+    {
+        double delta = 0.0001;
+
+        if ( x.size() < delta ) { x = x.expand( delta ); }
+        if ( y.size() < delta ) { y = y.expand( delta ); }
+        if ( z.size() < delta ) { z = z.expand( delta ); }
+    }
+};
+
+const aabb aabb::empty    = aabb( interval::empty,    interval::empty,    interval::empty );
+const aabb aabb::universe = aabb( interval::universe, interval::universe, interval::universe );
+
+#endif
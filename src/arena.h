@@ -0,0 +1,95 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * Bump allocator over one contiguous block whose size is fixed up front.
+ * Objects are destroyed in reverse order of creation with the arena itself;
+ * they cannot be freed one by one.
+ */
+class arena
+{
+public:
+    /* Every block starts on a cache line */
+    static constexpr std::size_t block_alignment = 64;
+
+    explicit arena( std::size_t capacity )
+        : block( static_cast<unsigned char*>( ::operator new( capacity, std::align_val_t( block_alignment ) ) ) ),
+          block_size( capacity )
+    {}
+
+    arena( const arena& ) = delete;
+    arena& operator=( const arena& ) = delete;
+
+    ~arena()
+    {
+        for ( auto it = destructors.rbegin(); it != destructors.rend(); ++it ) {
+            it->first( it->second );
+        }
+
+        ::operator delete( block, std::align_val_t( block_alignment ) );
+    }
+
+    /* Worst-case bytes taken by «count» objects of type «T», padding included */
+    template <typename T>
+    static constexpr std::size_t footprint( std::size_t count = 1 )
+    {
+        return ( count * sizeof( T ) ) + alignof( T ) - 1;
+    }
+
+    void* allocate( std::size_t size, std::size_t alignment )
+    {
+        std::size_t start = ( top + alignment - 1 ) & ~( alignment - 1 );
+
+        if ( start + size > block_size ) {
+            throw std::bad_alloc();
+        }
+
+        top = start + size;
+
+        return block + start;
+    }
+
+    template <typename T, typename... Args>
+    T* make( Args&&... args )
+    {
+        T* object = new ( allocate( sizeof( T ), alignof( T ) ) ) T( std::forward<Args>( args )... );
+
+        if ( ! std::is_trivially_destructible<T>::value ) {
+            destructors.emplace_back( []( void* p ) { static_cast<T*>( p )->~T(); }, object );
+        }
+
+        return object;
+    }
+
+    /* Copy of «count» trivially copyable values */
+    template <typename T>
+    T* copy( const T* values, std::size_t count )
+    {
+        static_assert( std::is_trivially_copyable<T>::value, "arena::copy needs plain data" );
+
+        T* array = static_cast<T*>( allocate( count * sizeof( T ), alignof( T ) ) );
+        for ( std::size_t i = 0; i < count; ++i ) {
+            array[i] = values[i];
+        }
+
+        return array;
+    }
+
+    std::size_t used( void ) const     { return top; }
+    std::size_t capacity( void ) const { return block_size; }
+
+private:
+    unsigned char* block;
+    std::size_t    block_size;
+    std::size_t    top = 0;
+
+    std::vector<std::pair<void ( * )( void* ), void*>> destructors;
+};
+
+#endif
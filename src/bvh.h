@@ -0,0 +1,242 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <thread>
+#include <vector>
+
+/* What the SAH builder needs to know about one primitive */
+struct bvh_primitive
+{
+    aabb   box;
+    point3 centroid;
+    size_t index;       /* Position of the primitive in the caller's object array */
+};
+
+/* Relative costs of visiting a node and of testing one primitive */
+const double bvh_traversal_cost    = 1.0;
+const double bvh_intersection_cost = 1.0;
+
+/*
+ * Result of «bvh_partition»: the range was split at «mid» along «axis» into
+ * two halves bounded by «left» and «right».  «cost» is the SAH estimate of that split,
+ * comparable with «count * bvh_intersection_cost» for keeping the range as a
+ * single leaf.
+ */
+struct bvh_split
+{
+    size_t mid;
+    int    axis;
+    double cost;
+    aabb   left;
+    aabb   right;
+};
+
+inline std::vector<bvh_primitive> bvh_primitives( const std::vector<shared_ptr<hittable>>& objects )
+{
+    std::vector<bvh_primitive> prims( objects.size() );
+
+    for ( size_t i = 0; i < objects.size(); ++i ) {
+        prims[i].box      = objects[i]->bounding_box();
+        prims[i].centroid = prims[i].box.centroid();
+        prims[i].index    = i;
+    }
+
+    return prims;
+}
+
+inline aabb bvh_bounds( const std::vector<bvh_primitive>& prims, size_t begin, size_t end )
+{
+    aabb bounds = aabb::empty;
+    for ( size_t i = begin; i < end; ++i ) {
+        bounds = aabb( bounds, prims[i].box );
+    }
+
+    return bounds;
+}
+
+/*
+ * Reorder «prims»[begin, end) around the cheapest split according to the
+ * surface area heuristic, evaluated over a fixed number of centroid bins on
+ * every axis.  Needs at least two primitives.
+ */
+inline bvh_split bvh_partition( std::vector<bvh_primitive>& prims, size_t begin, size_t end,
+                                const aabb& bounds )
+{
+    constexpr int bin_count = 16;
+
+    interval centroids[3];
+    for ( size_t i = begin; i < end; ++i ) {
+        for ( int axis = 0; axis < 3; ++axis ) {
+            centroids[axis].min = std::fmin( centroids[axis].min, prims[i].centroid[axis] );
+            centroids[axis].max = std::fmax( centroids[axis].max, prims[i].centroid[axis] );
+        }
+    }
+
+    double best_cost = infinity;
+    int    best_axis = -1;
+    int    best_bin  = -1;
+    aabb   best_left, best_right;
+
+    auto bin_of = [&]( const bvh_primitive& prim, int axis ) {
+        const interval& extent = centroids[axis];
+        int bin = int( bin_count * ( ( prim.centroid[axis] - extent.min ) / extent.size() ) );
+
+        return std::clamp( bin, 0, bin_count - 1 );
+    };
+
+    for ( int axis = 0; axis < 3; ++axis ) {
+        /* Centroids all share the same coordinate, nothing to split along */
+        if ( centroids[axis].size() <= 0 ) { continue; }
+
+        aabb   bin_boxes[bin_count];
+        size_t bin_counts[bin_count] = {};
+
+        for ( size_t i = begin; i < end; ++i ) {
+            int bin = bin_of( prims[i], axis );
+            bin_boxes[bin] = aabb( bin_boxes[bin], prims[i].box );
+            ++bin_counts[bin];
+        }
+
+        /* Sweep from the right to get the cost of every right-hand side */
+        double right_costs[bin_count];
+        aabb   right_boxes[bin_count];
+        size_t right_count = 0;
+        for ( int b = bin_count - 1; b > 0; --b ) {
+            right_boxes[b] = b + 1 < bin_count ? aabb( right_boxes[b + 1], bin_boxes[b] )
+                                               : bin_boxes[b];
+            right_count   += bin_counts[b];
+            right_costs[b] = right_count ? right_count * right_boxes[b].surface_area() : infinity;
+        }
+
+        aabb   left_box;
+        size_t left_count = 0;
+        for ( int b = 0; b < bin_count - 1; ++b ) {
+            left_box    = aabb( left_box, bin_boxes[b] );
+            left_count += bin_counts[b];
+            if ( left_count == 0 ) { continue; }
+
+            double cost = ( left_count * left_box.surface_area() ) + right_costs[b + 1];
+            if ( cost < best_cost ) {
+                best_cost  = cost;
+                best_axis  = axis;
+                best_bin   = b;
+                best_left  = left_box;
+                best_right = right_boxes[b + 1];
+            }
+        }
+    }
+
+    if ( best_axis < 0 ) {
+        /* Coincident centroids: any split is as good as another */
+        size_t mid = begin + ( end - begin ) / 2;
+
+        return { mid, bounds.longest_axis(), infinity,
+                 bvh_bounds( prims, begin, mid ), bvh_bounds( prims, mid, end ) };
+    }
+
+    auto mid = std::partition( prims.begin() + begin, prims.begin() + end,
+                               [&]( const bvh_primitive& prim ) {
+                                   return bin_of( prim, best_axis ) <= best_bin;
+                               } );
+
+    double area = bounds.surface_area();
+    double cost = bvh_traversal_cost
+                  + ( area > 0 ? bvh_intersection_cost * best_cost / area : 0 );
+
+    return { size_t( mid - prims.begin() ), best_axis, cost, best_left, best_right };
+}
+
+/*
+ * Bounding volume hierarchy over shared hittables, built top-down with the
+ * surface area heuristic.  Large subtrees near the root are built on their
+ * own threads.
+ */
+class bvh_node : public hittable
+{
+public:
+    bvh_node( const hittable_list& list ) : bvh_node( list.objects ) {}
+
+    bvh_node( const std::vector<shared_ptr<hittable>>& objects )
+    {
+        auto prims = bvh_primitives( objects );
+
+        unsigned threads = std::max( 1u, std::thread::hardware_concurrency() );
+        int parallel_depth = 0;
+        while ( ( 1u << parallel_depth ) < threads ) { ++parallel_depth; }
+
+        build( objects, prims, 0, prims.size(), bvh_bounds( prims, 0, prims.size() ),
+               parallel_depth + 1 );
+    }
+
+    bool hit( const ray& r, interval ray_t, hit_record& rec ) const override
+    {
+        if ( ! bbox.hit( r, ray_t ) ) {
+            return false;
+        }
+
+        bool hit_left  = left->hit( r, ray_t, rec );
+        bool hit_right = right->hit( r, interval( ray_t.min, hit_left ? rec.t : ray_t.max ), rec );
+
+        return hit_left || hit_right;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    shared_ptr<hittable> left;
+    shared_ptr<hittable> right;
+    aabb                 bbox;
+
+    /* Subtrees smaller than this are not worth a thread of their own */
+    static constexpr size_t parallel_threshold = 16384;
+
+    bvh_node() {}
+
+    void build( const std::vector<shared_ptr<hittable>>& objects,
+                std::vector<bvh_primitive>& prims, size_t begin, size_t end,
+                const aabb& bounds, int parallel_depth )
+    {
+        size_t span = end - begin;
+        bbox = bounds;
+
+        if ( span == 1 ) {
+            left = right = objects[prims[begin].index];
+            return;
+        }
+
+        if ( span == 2 ) {
+            left  = objects[prims[begin].index];
+            right = objects[prims[begin + 1].index];
+            return;
+        }
+
+        auto split = bvh_partition( prims, begin, end, bounds );
+
+        auto build_child = [&]( size_t child_begin, size_t child_end, const aabb& child_bounds ) {
+            auto child = shared_ptr<bvh_node>( new bvh_node() );
+            child->build( objects, prims, child_begin, child_end, child_bounds, parallel_depth - 1 );
+
+            return child;
+        };
+
+        if ( parallel_depth > 0 && span > parallel_threshold ) {
+            auto left_task = std::async( std::launch::async, build_child,
+                                         begin, split.mid, std::cref( split.left ) );
+            right = build_child( split.mid, end, split.right );
+            left  = left_task.get();
+        } else {
+            left  = build_child( begin, split.mid, split.left );
+            right = build_child( split.mid, end, split.right );
+        }
+    }
+};
+
+#endif
@@ -1,13 +1,24 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
-#include "stb_include.h"
-
 #include "rtweekend.h"
 #include "vec3.h"
 #include "color.h"
+#include "denoiser.h"
+#include "environment.h"
+#include "film.h"
 #include "hittable.h"
 #include "material.h"
+#include "sampler.h"
+#include "thread_pool.h"
+#include "wavefront.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
 
 class camera
 {
@@ -25,46 +36,286 @@ public:
     double defocus_angle  = 0;
     double focus_distance = 10;
 
-    int render( const hittable& world )
+    /*
+     * Final image and previews, in the format the extension names (see
+     * «film::write»); empty to render without writing one.
+     */
+    std::string image_path = "image.png";
+
+    /* If set, receives the accumulated samples once a render is done */
+    film* output_film = nullptr;
+
+    int thread_count = 0;       /* Render threads, 0 = hardware concurrency */
+    int tile_size    = 16;      /* Edge length of a square render tile, in pixels */
+
+    /*
+     * Russian roulette: from bounce «roulette_depth» on, a path carries on
+     * with probability equal to the largest component of its throughput, and
+     * survivors are weighted up by its inverse, so the estimate stays
+     * unbiased.  Paths whose throughput has dropped to black end regardless.
+     */
+    bool roulette       = false;
+    int  roulette_depth = 3;
+
+    /*
+     * Pattern of the numbers behind pixel jitter, lens position and every
+     * bounce; low-discrepancy patterns reach a given noise level with fewer
+     * samples.  Renders with different seeds are independent of each other.
+     */
+    sample_pattern sampling = sample_pattern::independent;
+    std::uint32_t  seed     = 0;
+
+    /* Trace primary rays in 4x4 packets; the image is the same either way */
+    bool packet_primary = false;
+
+    /* Trace paths breadth-first with the wavefront integrator */
+    bool wavefront       = false;
+    int  wavefront_batch = 1 << 14;     /* Paths in flight per tile */
+
+    /*
+     * Adaptive sampling: stop sampling a pixel once its estimated error in
+     * display-space luminance drops to «adaptive_threshold», after at least
+     * «adaptive_min_samples» and at most «samples_per_pixel» samples.
+     * Uses the single-ray path.
+     */
+    bool   adaptive             = false;
+    int    adaptive_min_samples = 16;
+    double adaptive_threshold   = 0.005;
+
+    /* Also write the per-pixel sample counts as a heatmap to «samples.png» */
+    bool write_sample_heatmap = false;
+
+    /*
+     * Progressive rendering: with «pass_samples» > 0, samples are added in
+     * passes of that many per pixel.  After a pass, once «checkpoint_interval»
+     * seconds have gone by since the last one, a preview is written to
+     * «image_path», and the accumulation buffer is saved to «checkpoint_path»
+     * if set.  With «resume», a render first loads that checkpoint and only adds
+     * the samples still missing.
+     */
+    int         pass_samples        = 0;
+    double      checkpoint_interval = 60;
+    std::string checkpoint_path;
+    bool        resume              = false;
+
+    /*
+     * Distributed rendering: this process renders shard «shard_index» of
+     * «shard_count», either every «shard_count»-th tile or, with
+     * «shard_by_samples», an equal slice of every pixel's samples.  With
+     * «film_path» set, the accumulation buffer is saved there for a later
+     * merge instead of writing «image_path».
+     */
+    int         shard_index      = 0;
+    int         shard_count      = 1;
+    bool        shard_by_samples = false;
+    std::string film_path;
+
+    /*
+     * Denoising: the image written to «image_path» is filtered by
+     * «denoise_film», guided by the albedo, normal and distance of first hits,
+     * which a pass of «guide_samples» primary rays per pixel collects after
+     * the render.  Checkpoints, saved films and «output_film» keep the raw
+     * samples.  With «guide_path» set the guides are written there as well
+     * (see «guide_buffers::write»); if set, «output_guides» receives them.
+     */
+    bool             denoise       = false;
+    denoise_settings denoising;
+    int              guide_samples = 16;
+    std::string      guide_path;
+    guide_buffers*   output_guides = nullptr;
+
+    /*
+     * With «rendered_film» set, «render» takes its samples instead of tracing
+     * any, and only traces the guides and writes the output: the last step
+     * after merging the films of shards rendered elsewhere, which cannot be
+     * denoised on their own.
+     */
+    const film* rendered_film = nullptr;
+
+    /*
+     * Environment lighting: with «environment» set, rays that leave the scene
+     * see that map instead of the sky gradient.  With «sample_environment»
+     * the single-ray integrators also send a shadow ray towards a direction
+     * drawn from the map at every lambertian bounce, and weigh it against the
+     * bounce itself by the power heuristic, so small bright lights are found
+     * without waiting for a bounce to hit them.  The wavefront integrator
+     * only looks up the map.
+     */
+    const environment_map* environment        = nullptr;
+    bool                   sample_environment = true;
+
+    /*
+     * Render «world», which is either any «hittable» or a closed-world view
+     * such as «typed_bvh».  Scattering goes through «Materials»::scatter; with
+     * a «material_set» of the scene's material types the whole integrator is
+     * instantiated for them and shading needs no virtual calls.
+     */
+    template <typename Materials = material_set<>, typename World = hittable>
+    int render( const World& world )
     {
+        RTW_STAT( stats::reset() );
+        RTW_STAT( stats::begin_phase( "setup" ) );
+
         initialize();
 
-        std::vector<unsigned char> pixels(image_width * image_height * 3);
+        /* Adaptive sampling picks its own sample counts, so it only shards by tiles */
+        bool by_samples  = shard_by_samples && ! adaptive;
+        int  shard_begin = by_samples ? int( ( long( samples_per_pixel ) * shard_index ) / shard_count ) : 0;
+        int  shard_end   = by_samples ? int( ( long( samples_per_pixel ) * ( shard_index + 1 ) ) / shard_count )
+                                      : samples_per_pixel;
+
+        film image( image_width, image_height );
+        int  samples_done = shard_begin;
+
+        if ( resume && ! checkpoint_path.empty() && ! adaptive ) {
+            if ( ! std::ifstream( checkpoint_path ) ) {
+                std::clog << "No checkpoint at " << checkpoint_path << ", starting from scratch\n";
+            } else if ( ! image.load( checkpoint_path ) ) {
+                std::cerr << "Error reading checkpoint " << checkpoint_path << std::endl;
+                return 1;
+            } else if ( image.width != image_width || image.height != image_height ) {
+                std::cerr << "Checkpoint " << checkpoint_path << " does not match the image size"
+                          << std::endl;
+                return 1;
+            } else if ( *std::max_element( image.counts.begin(), image.counts.end() )
+                        > std::uint32_t( shard_end - shard_begin ) ) {
+                std::cerr << "Checkpoint " << checkpoint_path << " has more samples per pixel than this render"
+                          << std::endl;
+                return 1;
+            } else {
+                /* Pixels outside this shard's tiles stay at zero samples */
+                samples_done += int( *std::max_element( image.counts.begin(), image.counts.end() ) );
+                std::clog << "Resuming from " << checkpoint_path << " at "
+                          << samples_done << " samples per pixel\n";
+            }
+        }
 
-        for ( int i = 0; i < image_height; ++i ) {
-            std::clog << "\rScanlines remaining: "
-                      << ( image_height - i ) << ' ' << std::flush;
+        if ( rendered_film != nullptr ) {
+            if ( rendered_film->width != image_width || rendered_film->height != image_height ) {
+                std::cerr << "Rendered film does not match the image size" << std::endl;
+                return 1;
+            }
 
-            for ( int j = 0; j < image_width; ++j ) {
-                color pixel_color( 0, 0, 0 );
+            image        = *rendered_film;
+            samples_done = shard_end;
+        }
+
+        int tiles_x = ( image_width  + tile_size - 1 ) / tile_size;
+        int tiles_y = ( image_height + tile_size - 1 ) / tile_size;
+
+        std::vector<int> tiles;
+        for ( int tile = 0; tile < tiles_x * tiles_y; ++tile ) {
+            if ( by_samples || tile % shard_count == shard_index ) {
+                tiles.push_back( tile );
+            }
+        }
+        int tile_count = int( tiles.size() );
+
+        int  pass        = ( pass_samples > 0 && ! adaptive ) ? pass_samples : samples_per_pixel;
+        bool progressive = pass < shard_end - shard_begin && rendered_film == nullptr;
+
+        std::mutex  log_lock;
+        thread_pool pool( thread_count );
 
-                for ( int sample = 0; sample < samples_per_pixel; ++sample ) {
-                    ray r = get_ray( j, i );
-                    pixel_color += ray_color( r, max_depth, world );
+        auto last_checkpoint = std::chrono::steady_clock::now();
+
+        RTW_STAT( stats::begin_phase( "trace" ) );
+
+        while ( samples_done < shard_end ) {
+            int sample_end = std::min( samples_done + pass, shard_end );
+
+            std::atomic<int> tiles_done( 0 );
+            pool.parallel_for( tile_count, [&]( size_t index ) {
+                int tile = tiles[index];
+                render_tile<Materials>( world, image, tile % tiles_x, tile / tiles_x, samples_done, sample_end );
+
+                int remaining = tile_count - ++tiles_done;
+                std::lock_guard<std::mutex> guard( log_lock );
+                std::clog << "\rSamples " << samples_done << "-" << sample_end
+                          << " of " << samples_per_pixel
+                          << ", tiles remaining: " << remaining << ' ' << std::flush;
+            } );
+
+            samples_done = sample_end;
+
+            auto now = std::chrono::steady_clock::now();
+            if ( progressive && samples_done < shard_end
+                 && std::chrono::duration<double>( now - last_checkpoint ).count() >= checkpoint_interval ) {
+                bool preview = film_path.empty() && ! image_path.empty();
+                if ( ( preview && ! write_image( image, image_path.c_str() ) ) || ! save_checkpoint( image ) ) {
+                    return 1;
                 }
+                last_checkpoint = now;
+            }
+        }
+
+        /* A shard saved as a film has only some samples; it is denoised once merged */
+        film denoised;
+        if ( film_path.empty() && ( denoise || ! guide_path.empty() || output_guides != nullptr ) ) {
+            RTW_STAT( stats::begin_phase( "denoise" ) );
 
-                size_t pixel_index = ( i * image_width + j ) * 3;
+            guide_buffers guides;
+            trace_guides<Materials>( world, pool, guides );
 
-                write_color( pixels, pixel_index, pixel_color * pixel_samples_scale );
+            if ( ! guide_path.empty() && ! guides.write( guide_path ) ) {
+                std::cerr << "Error writing guides " << guide_path << std::endl;
+                return 1;
+            }
+            if ( denoise ) {
+                denoised = denoise_film( image, guides, pool, denoising );
+            }
+            if ( output_guides != nullptr ) {
+                *output_guides = std::move( guides );
             }
         }
 
-        const char* filename = "image.png";
-        int result = stbi_write_png( filename,
-                                     image_width, image_height,
-                                     3, pixels.data(), image_width * 3 );
-        if ( result == 0 ) {
-            std::cerr << "Error writing PNG file." << std::endl;
+        RTW_STAT( stats::begin_phase( "output" ) );
+
+        if ( progressive && ! save_checkpoint( image ) ) {
+            return 1;
+        }
+
+        if ( output_film != nullptr ) {
+            *output_film = image;
+        }
+
+        if ( ! film_path.empty() ) {
+            if ( ! image.save( film_path ) ) {
+                std::cerr << "Error writing film " << film_path << std::endl;
+                return 1;
+            }
+
+            std::clog << "\rDone. Shard " << shard_index << " of " << shard_count
+                      << " saved as " << film_path << "\n";
+            RTW_STAT( stats::report( std::clog ) );
+            return 0;
+        }
+
+        if ( ! image_path.empty() && ! write_image( denoise ? denoised : image, image_path.c_str() ) ) {
+            return 1;
+        }
+
+        if ( adaptive ) {
+            double total = 0;
+            for ( auto count : image.counts ) { total += count; }
+
+            std::clog << "\rAdaptive sampling: " << total / image.counts.size()
+                      << " samples per pixel on average\n";
+        }
+
+        if ( write_sample_heatmap && ! write_heatmap( image, "samples.png" ) ) {
             return 1;
         }
 
-        std::clog << "\rDone. Image saved as " << filename << "\n";
+        if ( ! image_path.empty() ) {
+            std::clog << "\rDone. Image saved as " << image_path << "\n";
+        }
+        RTW_STAT( stats::report( std::clog ) );
         return 0;
     }
 
 private:
     int    image_height;
-    double pixel_samples_scale;
     point3 center;
     point3 pixel_0_0_location;
     vec3   pixel_delta_u;       /* Offset to pixel to the right */
@@ -74,13 +325,352 @@ private:
     vec3   defocus_disk_v;
 
 
+    /* Add samples [«sample_begin», «sample_end») of every pixel in a tile to «image» */
+    template <typename Materials, typename World>
+    void render_tile( const World& world, film& image, int tile_x, int tile_y,
+                      int sample_begin, int sample_end ) const
+    {
+        if ( adaptive ) {
+            render_tile_adaptive<Materials>( world, image, tile_x, tile_y );
+            return;
+        }
+
+        if ( wavefront ) {
+            render_tile_wavefront<Materials>( world, image, tile_x, tile_y, sample_begin, sample_end );
+            return;
+        }
+
+        if ( packet_primary ) {
+            render_tile_packets<Materials>( world, image, tile_x, tile_y, sample_begin, sample_end );
+            return;
+        }
+
+        int i_end = std::min( ( tile_y + 1 ) * tile_size, image_height );
+        int j_end = std::min( ( tile_x + 1 ) * tile_size, image_width );
+
+        for ( int i = tile_y * tile_size; i < i_end; ++i ) {
+            for ( int j = tile_x * tile_size; j < j_end; ++j ) {
+                size_t pixel = size_t( i ) * image_width + j;
+
+                color pixel_color( 0, 0, 0 );
+
+                for ( int sample = sample_begin; sample < sample_end; ++sample ) {
+                    /* One sampler per pixel and sample keeps the image independent of scheduling */
+                    sampler gen = pixel_sampler( j, i, sample );
+
+                    ray r = get_ray( j, i, gen );
+                    pixel_color += ray_color<Materials>( r, world, gen );
+                }
+
+                image.add( pixel, pixel_color, sample_end - sample_begin );
+            }
+        }
+    }
+
+    /*
+     * Same as «render_tile», but pixels take samples in batches of
+     * «adaptive_min_samples» and stop once their error estimate is below
+     * «adaptive_threshold».  A pixel's error is the difference in display-space
+     * luminance between the mean of all its samples and the mean of only the
+     * even-numbered ones, averaged over its 3x3 neighbourhood in the tile, as a
+     * single pixel's estimate is too noisy to stop on.
+     */
+    template <typename Materials, typename World>
+    void render_tile_adaptive( const World& world, film& image,
+                               int tile_x, int tile_y ) const
+    {
+        int i_begin = tile_y * tile_size, i_end = std::min( i_begin + tile_size, image_height );
+        int j_begin = tile_x * tile_size, j_end = std::min( j_begin + tile_size, image_width );
+        int tile_w  = j_end - j_begin;
+        int tile_h  = i_end - i_begin;
+        int count   = tile_w * tile_h;
+        int batch   = std::max( 1, adaptive_min_samples );
+
+        std::vector<color>  sums( count ), even_sums( count );
+        std::vector<int>    samples( count, 0 );
+        std::vector<double> errors( count, 0 );
+        std::vector<char>   active( count, 1 );
+
+        auto display = []( const color& c ) {
+            return linear_to_gamma( std::fmin( luminance( c ), 1.0 ) );
+        };
+
+        for ( bool any_active = true; any_active; ) {
+            for ( int p = 0; p < count; ++p ) {
+                if ( ! active[p] ) { continue; }
+
+                int i    = i_begin + ( p / tile_w );
+                int j    = j_begin + ( p % tile_w );
+                int last = std::min( samples[p] + batch, samples_per_pixel );
+
+                for ( int sample = samples[p]; sample < last; ++sample ) {
+                    sampler gen = pixel_sampler( j, i, sample );
+
+                    ray   r = get_ray( j, i, gen );
+                    color c = ray_color<Materials>( r, world, gen );
+
+                    sums[p] += c;
+                    if ( sample % 2 == 0 ) { even_sums[p] += c; }
+                }
+
+                samples[p] = last;
+                errors[p]  = std::fabs( display( sums[p] / samples[p] )
+                                        - display( even_sums[p] / ( ( samples[p] + 1 ) / 2 ) ) );
+            }
+
+            any_active = false;
+            for ( int p = 0; p < count; ++p ) {
+                if ( ! active[p] ) { continue; }
+
+                int    pi = p / tile_w, pj = p % tile_w;
+                double window_error = 0;
+                int    window_size  = 0;
+                for ( int di = std::max( 0, pi - 1 ); di <= std::min( tile_h - 1, pi + 1 ); ++di ) {
+                    for ( int dj = std::max( 0, pj - 1 ); dj <= std::min( tile_w - 1, pj + 1 ); ++dj ) {
+                        window_error += errors[di * tile_w + dj];
+                        ++window_size;
+                    }
+                }
+
+                if ( samples[p] >= samples_per_pixel || window_error / window_size <= adaptive_threshold ) {
+                    active[p] = 0;
+                } else {
+                    any_active = true;
+                }
+            }
+        }
+
+        for ( int p = 0; p < count; ++p ) {
+            size_t pixel = size_t( i_begin + ( p / tile_w ) ) * image_width + j_begin + ( p % tile_w );
+            image.add( pixel, sums[p], samples[p] );
+        }
+    }
+
+    /*
+     * Same as «render_tile», but each sample of a 4x4 pixel block traces its
+     * primary rays as one packet.  Every lane keeps its own generator, and
+     * bounces past the primary hit are traced one ray at a time.
+     */
+    template <typename Materials, typename World>
+    void render_tile_packets( const World& world, film& image, int tile_x, int tile_y,
+                              int sample_begin, int sample_end ) const
+    {
+        constexpr int width = ray_packet::width;
+
+        int i_end = std::min( ( tile_y + 1 ) * tile_size, image_height );
+        int j_end = std::min( ( tile_x + 1 ) * tile_size, image_width );
+
+        for ( int block_i = tile_y * tile_size; block_i < i_end; block_i += width ) {
+            for ( int block_j = tile_x * tile_size; block_j < j_end; block_j += width ) {
+                int   lane_i[ray_packet::size], lane_j[ray_packet::size];
+                color lane_color[ray_packet::size];
+                int   count = 0;
+
+                for ( int i = block_i; i < std::min( block_i + width, i_end ); ++i ) {
+                    for ( int j = block_j; j < std::min( block_j + width, j_end ); ++j ) {
+                        lane_i[count] = i;
+                        lane_j[count] = j;
+                        ++count;
+                    }
+                }
+
+                for ( int sample = sample_begin; sample < sample_end; ++sample ) {
+                    ray_packet packet;
+                    sampler    gens[ray_packet::size];
+                    hit_record recs[ray_packet::size];
+                    bool       hits[ray_packet::size];
+
+                    packet.count = count;
+                    for ( int lane = 0; lane < count; ++lane ) {
+                        gens[lane]        = pixel_sampler( lane_j[lane], lane_i[lane], sample );
+                        packet.rays[lane] = get_ray( lane_j[lane], lane_i[lane], gens[lane] );
+                    }
+
+                    if ( max_depth <= 0 ) { continue; }
+
+                    world.hit_packet( packet, ray_interval, recs, hits );
+                    RTW_STAT( stats::local().rays[0] += count );
+
+                    for ( int lane = 0; lane < count; ++lane ) {
+                        const ray& r = packet.rays[lane];
+                        RTW_STAT( if ( ! hits[lane] ) { ++stats::local().path_lengths[0]; } );
+                        lane_color[lane] += hits[lane]
+                                            ? shade<Materials>( r, recs[lane], world, gens[lane] )
+                                            : background( r );
+                    }
+                }
+
+                for ( int lane = 0; lane < count; ++lane ) {
+                    size_t pixel = size_t( lane_i[lane] ) * image_width + lane_j[lane];
+                    image.add( pixel, lane_color[lane], sample_end - sample_begin );
+                }
+            }
+        }
+    }
+
+    /*
+     * Same as «render_tile», but through the wavefront integrator.  The tile's
+     * samples go through in chunks of at most «wavefront_batch» paths; each
+     * path's radiance lands in its own slot and is summed in sample order.
+     */
+    template <typename Materials, typename World>
+    void render_tile_wavefront( const World& world, film& image, int tile_x, int tile_y,
+                                int sample_begin, int sample_end ) const
+    {
+        int i_begin = tile_y * tile_size, i_end = std::min( i_begin + tile_size, image_height );
+        int j_begin = tile_x * tile_size, j_end = std::min( j_begin + tile_size, image_width );
+        int tile_w  = j_end - j_begin;
+        int count   = tile_w * ( i_end - i_begin );
+
+        int chunk = std::max( 1, std::min( sample_end - sample_begin, wavefront_batch / count ) );
+
+        /* Kept per thread, so that its buffers are allocated only once */
+        static thread_local wavefront_integrator integrator;
+        static thread_local std::vector<color>   radiance;
+
+        std::vector<color> pixel_colors( count );
+
+        auto bg = [this]( const ray& r ) { return background( r ); };
+
+        for ( int first = sample_begin; first < sample_end; first += chunk ) {
+            int last = std::min( first + chunk, sample_end );
+
+            radiance.assign( size_t( count ) * ( last - first ), color( 0, 0, 0 ) );
+
+            for ( int p = 0; p < count; ++p ) {
+                int i = i_begin + ( p / tile_w );
+                int j = j_begin + ( p % tile_w );
+
+                for ( int sample = first; sample < last; ++sample ) {
+                    sampler gen = pixel_sampler( j, i, sample );
+                    ray     r   = get_ray( j, i, gen );
+
+                    integrator.add_path( r, gen, std::uint32_t( p * ( last - first ) + ( sample - first ) ) );
+                }
+            }
+
+            integrator.trace<Materials>( world, max_depth, roulette ? roulette_depth : -1, bg, radiance );
+
+            for ( int p = 0; p < count; ++p ) {
+                for ( int s = 0; s < last - first; ++s ) {
+                    pixel_colors[p] += radiance[size_t( p ) * ( last - first ) + s];
+                }
+            }
+        }
+
+        for ( int p = 0; p < count; ++p ) {
+            size_t pixel = size_t( i_begin + ( p / tile_w ) ) * image_width + j_begin + ( p % tile_w );
+            image.add( pixel, pixel_colors[p], sample_end - sample_begin );
+        }
+    }
+
+    /*
+     * Guides for the denoiser, from samples [0, «guide_samples») of every
+     * pixel, the primary rays the render started its paths with.  Through
+     * specular surfaces the guides follow the scattered ray, at most
+     * «max_guide_bounces» times, so that what a mirror reflects keeps its
+     * edges: the albedo is tinted by the surfaces passed, the normal is the
+     * one where the ray stops, and the distance is measured along the path.
+     */
+    template <typename Materials, typename World>
+    void trace_guides( const World& world, thread_pool& pool, guide_buffers& guides ) const
+    {
+        static constexpr int max_guide_bounces = 8;
+
+        int samples = std::max( 1, guide_samples );
+        guides      = guide_buffers( image_width, image_height );
+
+        pool.parallel_for( size_t( image_height ), [&]( size_t row ) {
+            int i = int( row );
+            for ( int j = 0; j < image_width; ++j ) {
+                color  albedo( 0, 0, 0 );
+                vec3   normal( 0, 0, 0 );
+                double depth = 0;
+
+                for ( int sample = 0; sample < samples; ++sample ) {
+                    sampler gen = pixel_sampler( j, i, sample );
+
+                    ray        r = get_ray( j, i, gen );
+                    hit_record rec;
+                    color      tint( 1, 1, 1 );
+
+                    for ( int bounce = 0; ; ++bounce ) {
+                        if ( ! world.hit( r, ray_interval, rec ) ) {
+                            albedo += tint * background( r );
+                            break;
+                        }
+
+                        depth += rec.t * r.direction().length();
+
+                        ray   scattered;
+                        color attenuation;
+                        if ( bounce == max_guide_bounces || ! rec.mat->specular()
+                             || ! Materials::scatter( *rec.mat, r, rec, attenuation, scattered, gen ) ) {
+                            albedo += tint * rec.mat->surface_albedo( rec );
+                            normal += rec.normal;
+                            break;
+                        }
+
+                        tint = tint * attenuation;
+                        r    = scattered;
+                    }
+                }
+
+                guides.set( ( size_t( i ) * image_width ) + j, albedo / real( samples ), normal / real( samples ),
+                            depth / samples );
+            }
+        } );
+    }
+
+    bool write_image( const film& image, const char* filename ) const
+    {
+        if ( ! image.write( filename ) ) {
+            std::cerr << "Error writing image file " << filename << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool save_checkpoint( const film& image ) const
+    {
+        if ( checkpoint_path.empty() ) { return true; }
+
+        if ( ! image.save( checkpoint_path ) ) {
+            std::cerr << "Error writing checkpoint " << checkpoint_path << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    /* Sample counts on a black-red-yellow-white ramp, white = «samples_per_pixel» */
+    bool write_heatmap( const film& image, const char* filename ) const
+    {
+        std::vector<unsigned char> heat( image.counts.size() * 3 );
+
+        for ( size_t pixel = 0; pixel < image.counts.size(); ++pixel ) {
+            double t = double( image.counts[pixel] ) / samples_per_pixel;
+
+            heat[pixel * 3]     = (unsigned char)( 255 * std::clamp( 3 * t,     0.0, 1.0 ) );
+            heat[pixel * 3 + 1] = (unsigned char)( 255 * std::clamp( 3 * t - 1, 0.0, 1.0 ) );
+            heat[pixel * 3 + 2] = (unsigned char)( 255 * std::clamp( 3 * t - 2, 0.0, 1.0 ) );
+        }
+
+        if ( ! stbi_write_png( filename, image.width, image.height, 3, heat.data(), image.width * 3 ) ) {
+            std::cerr << "Error writing PNG file." << std::endl;
+            return false;
+        }
+
+        std::clog << "Sample heatmap saved as " << filename << "\n";
+        return true;
+    }
+
     void initialize( void )
     {
         image_height = int( image_width / aspect_ratio );
         image_height = image_height < 1 ? 1 : image_height;
 
-        pixel_samples_scale = 1.0 / samples_per_pixel;
-
         center = look_from;
 
         auto theta           = degrees_to_radians( v_fov );
@@ -115,51 +705,157 @@ private:
      * Constract a camera ray directed from the defocus disk,
      * directed a randomly sampled point around the pixel location «i», «j».
      */
-    ray get_ray( int i, int j ) const
+    ray get_ray( int i, int j, sampler& gen ) const
     {
-        auto offset       = sample_square();
+        auto offset       = sample_square( gen );
         auto pixel_sample = pixel_0_0_location
                             + ( ( i + offset.x() ) * pixel_delta_u )
                             + ( ( j + offset.y() ) * pixel_delta_v );
 
-        auto ray_origin    = defocus_angle <= 0 ? center : defocus_disk_sample();
+        auto ray_origin    = defocus_angle <= 0 ? center : defocus_disk_sample( gen );
         auto ray_direction = pixel_sample - ray_origin;
 
         return ray( ray_origin, ray_direction );
     }
 
+    /* The numbers of sample «sample» of the pixel in column «j» and row «i» */
+    sampler pixel_sampler( int j, int i, int sample ) const
+    {
+        return sampler( sampling, j, i, size_t( i ) * image_width + j, sample, seed );
+    }
+
     /*
      * Return the vector to a random point in the [-0.5, -0.5]-[0.5, 0.5] unit square.
      */
-    vec3 sample_square( void ) const
+    vec3 sample_square( sampler& gen ) const
     {
-        return vec3( random_double() - 0.5, random_double() - 0.5, 0 );
+        double u1, u2;
+        gen.next_2d( u1, u2 );
+
+        return vec3( u1 - 0.5, u2 - 0.5, 0 );
     }
 
-    point3 defocus_disk_sample() const
+    point3 defocus_disk_sample( sampler& gen ) const
     {
-        auto p = random_in_unit_disk();
+        auto p = sample_disk_concentric( gen );
 
         return center + ( p[0] * defocus_disk_u ) + ( p[1] * defocus_disk_v );
     }
 
-    color ray_color( const ray& r, int depth, const hittable& world ) const
+    template <typename Materials, typename World>
+    color ray_color( const ray& r, const World& world, sampler& gen ) const
     {
-        if ( depth <= 0 ) { return color( 0, 0, 0 ); }
+        if ( max_depth <= 0 ) {
+            RTW_STAT( ++stats::local().path_lengths[0] );
+            return color( 0, 0, 0 );
+        }
 
         hit_record rec;
 
-        if ( world.hit( r, interval( 0.001, infinity ), rec ) ) {
+        RTW_STAT( ++stats::local().rays[0] );
+        if ( world.hit( r, ray_interval, rec ) ) {
+            return shade<Materials>( r, rec, world, gen );
+        }
+
+        RTW_STAT( ++stats::local().path_lengths[0] );
+        return background( r );
+    }
+
+    /*
+     * Radiance carried back along «r», which hit the scene at «rec».  The path
+     * is followed bounce by bounce, carrying the product of the attenuations
+     * so far, until it leaves the scene, is absorbed or has traced «max_depth»
+     * rays.
+     */
+    template <typename Materials, typename World>
+    color shade( ray r, hit_record rec, const World& world, sampler& gen ) const
+    {
+        color throughput( 1, 1, 1 );
+        color radiance( 0, 0, 0 );
+
+        bool light_sampling = sample_environment && environment != nullptr && environment->can_sample();
+
+        /* Density of the last bounce's direction, for weighing the map it escapes to; 0 after a specular one */
+        double bounce_pdf = 0;
+
+        /* Rays traced so far; a path ending here is counted with this length */
+        for ( int bounce = 1; ; ++bounce ) {
             ray   scattered;
             color attenuation;
 
-            if ( rec.mat->scatter( r, rec, attenuation, scattered ) ) {
-                return attenuation * ray_color( scattered, depth - 1, world );
+            if ( ! Materials::scatter( *rec.mat, r, rec, attenuation, scattered, gen ) ) {
+                RTW_STAT( ++stats::local().path_lengths[stats_counters::bounce_bucket( bounce - 1 )] );
+                return radiance;
             }
 
-            return color( 0, 0, 0 );
+            bool diffuse = light_sampling && rec.mat->kind == lambertian::kind_id;
+
+            /* The shadow ray stands in for the next bounce, so only where there is one */
+            if ( diffuse && bounce < max_depth ) {
+                radiance += throughput * sample_light( world, rec, attenuation, gen );
+            }
+
+            bounce_pdf = diffuse ? std::max( 0.0, double( dot( rec.normal, unit_vector( scattered.direction() ) ) ) ) / pi
+                                 : 0;
+            throughput = throughput * attenuation;
+
+            if ( bounce >= max_depth || ! survives_roulette( throughput, roulette ? roulette_depth : -1, bounce, gen ) ) {
+                RTW_STAT( ++stats::local().path_lengths[stats_counters::bounce_bucket( bounce )] );
+                return radiance;
+            }
+
+            r = scattered;
+
+            RTW_STAT( ++stats::local().rays[stats_counters::bounce_bucket( bounce )] );
+            if ( ! world.hit( r, ray_interval, rec ) ) {
+                RTW_STAT( ++stats::local().path_lengths[stats_counters::bounce_bucket( bounce )] );
+                return radiance + ( throughput * background( r ) * real( escape_weight( r, bounce_pdf ) ) );
+            }
         }
+    }
 
+    /*
+     * Light from the environment map reaching the lambertian surface at «rec»
+     * along one direction drawn from the map, with «albedo» its attenuation,
+     * weighed for multiple importance sampling against the cosine-distributed
+     * bounce.
+     */
+    template <typename World>
+    color sample_light( const World& world, const hit_record& rec, const color& albedo, sampler& gen ) const
+    {
+        double u1, u2;
+        gen.next_2d( u1, u2 );
+
+        vec3   wi;
+        double light_pdf;
+        color  light = environment->sample( u1, u2, wi, light_pdf );
+
+        double cosine = dot( rec.normal, wi );
+        if ( ! ( light_pdf > 0 ) || cosine <= 0 ) { return color( 0, 0, 0 ); }
+
+        hit_record shadow;
+        RTW_STAT( ++stats::local().shadow_rays );
+        if ( world.hit( rec.spawn_ray( wi ), ray_interval, shadow ) ) { return color( 0, 0, 0 ); }
+
+        double bsdf_pdf = cosine / pi;
+        double weight   = ( light_pdf * light_pdf ) / ( ( light_pdf * light_pdf ) + ( bsdf_pdf * bsdf_pdf ) );
+
+        return albedo * light * real( bsdf_pdf * weight / light_pdf );
+    }
+
+    /* Power-heuristic weight of a bounce drawn with density «bounce_pdf» escaping along «r»; 1 if the map was not sampled */
+    double escape_weight( const ray& r, double bounce_pdf ) const
+    {
+        if ( ! ( bounce_pdf > 0 ) ) { return 1; }
+
+        double light_pdf = environment->pdf( r.direction() );
+
+        return ( bounce_pdf * bounce_pdf ) / ( ( bounce_pdf * bounce_pdf ) + ( light_pdf * light_pdf ) );
+    }
+
+    color background( const ray& r ) const
+    {
+        if ( environment != nullptr ) { return environment->radiance( r.direction() ); }
 
         vec3 unit_direction = unit_vector( r.direction() );
         auto a = 0.5 * ( unit_direction.y() + 1.0 );
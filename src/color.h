@@ -3,11 +3,15 @@
 
 #include "vec3.h"
 #include "interval.h"
+#include "sampler.h"
 
 #include <vector>
 
 using color = vec3;
 
+/* Sum of many samples, kept in double precision whatever «real» is */
+using color_sum = vec3_t<double>;
+
 inline double linear_to_gamma( double linear_component )
 {
     if ( linear_component > 0 ) {
@@ -17,6 +21,32 @@ inline double linear_to_gamma( double linear_component )
     return 0;
 }
 
+/* Relative luminance of a linear Rec. 709 color */
+inline double luminance( const color& c )
+{
+    return ( 0.2126 * c.x() ) + ( 0.7152 * c.y() ) + ( 0.0722 * c.z() );
+}
+
+/*
+ * Russian roulette for a path whose «throughput» is the product of its
+ * attenuations after «bounce» bounces.  From bounce «start» on (never if it
+ * is negative) the path survives with probability equal to the throughput's
+ * largest component, and a survivor's throughput is divided by that
+ * probability.  A black path never survives: it cannot add anything more.
+ */
+inline bool survives_roulette( color& throughput, int start, int bounce, sampler& gen )
+{
+    real p = std::fmax( throughput.x(), std::fmax( throughput.y(), throughput.z() ) );
+
+    if ( p <= 0 ) { return false; }
+    if ( start < 0 || bounce < start || p >= 1 ) { return true; }
+
+    if ( gen.next_1d() >= p ) { return false; }
+
+    throughput /= p;
+    return true;
+}
+
 inline void write_color( std::vector<unsigned char>& pixels,
                          size_t pixel_index, const color& pixel_color )
 {
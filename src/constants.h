@@ -3,7 +3,27 @@
 
 #include <limits>
 
+/* Scalar type of the renderer's geometry; define RTW_FLOAT for single precision */
+#ifdef RTW_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
 const double infinity = std::numeric_limits<double>::infinity();
 const double pi = 3.1415926535897932385;
 
+/*
+ * «material::kind» tags of the standard materials, here rather than in
+ * material.h so the render statistics can count by them
+ */
+struct material_kinds
+{
+    static constexpr int other      = 0;    /* Any material but the standard ones */
+    static constexpr int lambertian = 1;
+    static constexpr int metal      = 2;
+    static constexpr int dielectric = 3;
+    static constexpr int count      = 4;
+};
+
 #endif
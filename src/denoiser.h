@@ -0,0 +1,378 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "rtweekend.h"
+#include "color.h"
+#include "film.h"
+#include "thread_pool.h"
+#include "vec3.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define DENOISER_X86 1
+#include <emmintrin.h>
+#endif
+
+/*
+ * Per-pixel guides for the denoiser: albedo, normal and distance of the
+ * first hits, averaged over a pixel's primary rays.  Rays that miss count
+ * the background as their albedo and zero for normal and distance.  Each
+ * channel is a plane of its own, so the filter reads them a row at a time.
+ */
+struct guide_buffers
+{
+    int width  = 0;
+    int height = 0;
+
+    std::vector<float> albedo[3];
+    std::vector<float> normal[3];
+    std::vector<float> depth;
+
+    guide_buffers() {}
+
+    guide_buffers( int width, int height ) : width( width ), height( height ), depth( size_t( width ) * height, 0 )
+    {
+        for ( int c = 0; c < 3; ++c ) {
+            albedo[c].assign( depth.size(), 0 );
+            normal[c].assign( depth.size(), 0 );
+        }
+    }
+
+    void set( size_t pixel, const color& pixel_albedo, const vec3& pixel_normal, double pixel_depth )
+    {
+        for ( int c = 0; c < 3; ++c ) {
+            albedo[c][pixel] = float( pixel_albedo[c] );
+            normal[c][pixel] = float( pixel_normal[c] );
+        }
+        depth[pixel] = float( pixel_depth );
+    }
+
+    /*
+     * Write the guides through «film::write», to «path» with "_albedo",
+     * "_normal" or "_depth" before its extension.  Normals are written as
+     * they are, in [-1, 1]; distance goes to all three channels.
+     */
+    bool write( const std::string& path ) const
+    {
+        size_t slash = path.find_last_of( '/' );
+        size_t dot   = path.find_last_of( '.' );
+        if ( dot == std::string::npos || ( slash != std::string::npos && dot < slash ) ) { dot = path.size(); }
+
+        auto named = [&]( const char* suffix ) { return path.substr( 0, dot ) + suffix + path.substr( dot ); };
+        auto plane = [&]( const std::vector<float>* channels, bool single ) {
+            film planes( width, height );
+            for ( size_t pixel = 0; pixel < depth.size(); ++pixel ) {
+                planes.add( pixel, single ? color( channels[0][pixel], channels[0][pixel], channels[0][pixel] )
+                                          : color( channels[0][pixel], channels[1][pixel], channels[2][pixel] ), 1 );
+            }
+            return planes;
+        };
+
+        return plane( albedo, false ).write( named( "_albedo" ) )
+               && plane( normal, false ).write( named( "_normal" ) )
+               && plane( &depth, true ).write( named( "_depth" ) );
+    }
+};
+
+/*
+ * Edge-stopping strengths of the filter.  A neighbour's weight falls off
+ * with its squared difference from the pixel in each quantity, measured in
+ * units of the sigma: colour in standard deviations of the pixel's noise,
+ * in the irradiance left after dividing out the albedo; distance relative
+ * to the nearer of the two; the other guides as they are.  The colour sigma
+ * halves at every iteration, as the image gets smoother.
+ */
+struct denoise_settings
+{
+    int   iterations   = 5;
+    float sigma_color  = 2.0f;
+    float sigma_normal = 0.2f;
+    float sigma_albedo = 0.1f;
+    float sigma_depth  = 0.05f;
+};
+
+namespace denoise_detail
+{
+
+const float log2e = 1.442695f;
+
+/* 2^y for y in [-126, 0], to about 0.2%: plenty for filter weights, and cheap enough for every tap */
+inline float exp2_negative( float y )
+{
+    y = std::max( y, -126.0f );
+
+    int   i = int( y );             /* Truncates towards zero, so f is in (-1, 0] */
+    float f = y - float( i );
+    float p = 1 + ( f * ( 0.693147f + ( f * ( 0.240227f + ( f * ( 0.0555041f + ( f * 0.00961813f ) ) ) ) ) ) );
+
+    std::uint32_t bits = std::uint32_t( i + 127 ) << 23;
+    float         scale;
+    std::memcpy( &scale, &bits, sizeof( scale ) );
+
+    return p * scale;
+}
+
+#if DENOISER_X86
+inline __m128 exp2_negative( __m128 y )
+{
+    y = _mm_max_ps( y, _mm_set1_ps( -126.0f ) );
+
+    __m128i i = _mm_cvttps_epi32( y );
+    __m128  f = _mm_sub_ps( y, _mm_cvtepi32_ps( i ) );
+    __m128  p = _mm_set1_ps( 0.00961813f );
+    p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( 0.0555041f ) );
+    p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( 0.240227f ) );
+    p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( 0.693147f ) );
+    p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( 1.0f ) );
+
+    __m128i bits = _mm_slli_epi32( _mm_add_epi32( i, _mm_set1_epi32( 127 ) ), 23 );
+
+    return _mm_mul_ps( p, _mm_castsi128_ps( bits ) );
+}
+#endif
+
+/* Planes of a pass: colour in, colour out, the guides, and each pixel's colour weight */
+struct planes
+{
+    const float* color[3];
+    const float* albedo[3];
+    const float* normal[3];
+    const float* depth;
+    const float* inv_color;     /* log2 e / colour sigma², per pixel */
+    float*       output[3];
+};
+
+/* One tap of the kernel along a row: the row starts at pixel «p», and each pixel's neighbour is «offset» further on */
+struct tap
+{
+    size_t p, offset;
+    float  kernel;
+    float  inv_normal, inv_albedo, inv_depth;       /* log2 e / sigma², the depth one per step */
+};
+
+/* Add the weights and weighted colours of tap «t» for pixels [«begin», «end») of a row to the row's sums */
+inline void accumulate( const planes& in, const tap& t, int begin, int end,
+                        float* weights, float* const* sums )
+{
+    /* Weight is kernel · 2^-( Σ differences² / sigma² ), the sum already scaled by log2 e */
+    auto exponent = [&]( size_t p, size_t q ) {
+        float dc = 0, dn = 0, da = 0;
+        for ( int c = 0; c < 3; ++c ) {
+            float d = in.color[c][p] - in.color[c][q];
+            float n = in.normal[c][p] - in.normal[c][q];
+            float a = in.albedo[c][p] - in.albedo[c][q];
+            dc += d * d;
+            dn += n * n;
+            da += a * a;
+        }
+        float scale = std::max( in.depth[p], in.depth[q] ) + 1e-6f;
+        float dz    = ( in.depth[p] - in.depth[q] ) / scale;
+
+        return ( dc * in.inv_color[p] ) + ( dn * t.inv_normal ) + ( da * t.inv_albedo ) + ( dz * dz * t.inv_depth );
+    };
+
+    int x = begin;
+
+#if DENOISER_X86
+    const __m128 inv_normal = _mm_set1_ps( t.inv_normal );
+    const __m128 inv_albedo = _mm_set1_ps( t.inv_albedo );
+    const __m128 inv_depth  = _mm_set1_ps( t.inv_depth );
+    const __m128 kernel     = _mm_set1_ps( t.kernel );
+    const __m128 tiny       = _mm_set1_ps( 1e-6f );
+    const __m128 zero       = _mm_setzero_ps();
+
+    for ( ; x + 4 <= end; x += 4 ) {
+        size_t p = t.p + size_t( x ), q = p + t.offset;
+
+        __m128 dc = zero, dn = zero, da = zero;
+        __m128 qc[3];
+        for ( int c = 0; c < 3; ++c ) {
+            qc[c]    = _mm_loadu_ps( in.color[c] + q );
+            __m128 d = _mm_sub_ps( _mm_loadu_ps( in.color[c] + p ), qc[c] );
+            __m128 n = _mm_sub_ps( _mm_loadu_ps( in.normal[c] + p ), _mm_loadu_ps( in.normal[c] + q ) );
+            __m128 a = _mm_sub_ps( _mm_loadu_ps( in.albedo[c] + p ), _mm_loadu_ps( in.albedo[c] + q ) );
+            dc = _mm_add_ps( dc, _mm_mul_ps( d, d ) );
+            dn = _mm_add_ps( dn, _mm_mul_ps( n, n ) );
+            da = _mm_add_ps( da, _mm_mul_ps( a, a ) );
+        }
+
+        __m128 zp = _mm_loadu_ps( in.depth + p ), zq = _mm_loadu_ps( in.depth + q );
+        __m128 dz = _mm_div_ps( _mm_sub_ps( zp, zq ), _mm_add_ps( _mm_max_ps( zp, zq ), tiny ) );
+
+        __m128 e = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dc, _mm_loadu_ps( in.inv_color + p ) ), _mm_mul_ps( dn, inv_normal ) ),
+                               _mm_add_ps( _mm_mul_ps( da, inv_albedo ), _mm_mul_ps( _mm_mul_ps( dz, dz ), inv_depth ) ) );
+        __m128 w = _mm_mul_ps( kernel, exp2_negative( _mm_sub_ps( zero, e ) ) );
+
+        _mm_storeu_ps( weights + x, _mm_add_ps( _mm_loadu_ps( weights + x ), w ) );
+        for ( int c = 0; c < 3; ++c ) {
+            _mm_storeu_ps( sums[c] + x, _mm_add_ps( _mm_loadu_ps( sums[c] + x ), _mm_mul_ps( w, qc[c] ) ) );
+        }
+    }
+#endif
+
+    for ( ; x < end; ++x ) {
+        size_t p = t.p + size_t( x ), q = p + t.offset;
+        float  w = t.kernel * exp2_negative( -exponent( p, q ) );
+
+        weights[x] += w;
+        for ( int c = 0; c < 3; ++c ) {
+            sums[c][x] += w * in.color[c][q];
+        }
+    }
+}
+
+/* One à-trous pass over row «y», with taps «step» pixels apart */
+inline void filter_row( const planes& in, int width, int height, int y, int step, const denoise_settings& settings,
+                        std::vector<float>& scratch )
+{
+    static const float kernel[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+
+    scratch.assign( size_t( width ) * 4, 0 );
+    float* weights = scratch.data();
+    float* sums[3] = { weights + width, weights + ( 2 * width ), weights + ( 3 * width ) };
+
+    /* Depth differences grow with the distance between taps, so their sigma does too */
+    tap t;
+    t.inv_normal = log2e / ( settings.sigma_normal * settings.sigma_normal );
+    t.inv_albedo = log2e / ( settings.sigma_albedo * settings.sigma_albedo );
+    t.inv_depth  = log2e / ( settings.sigma_depth * settings.sigma_depth * float( step * step ) );
+
+    for ( int ky = 0; ky < 5; ++ky ) {
+        int qy = y + ( ( ky - 2 ) * step );
+        if ( qy < 0 || qy >= height ) { continue; }
+
+        for ( int kx = 0; kx < 5; ++kx ) {
+            int dx = ( kx - 2 ) * step;
+
+            /* Taps that would fall outside the image are left out, and the weights renormalized */
+            int begin = std::max( 0, -dx ), end = std::min( width, width - dx );
+            if ( begin >= end ) { continue; }
+
+            t.p      = size_t( y ) * width;
+            t.offset = size_t( ( ( qy - y ) * std::ptrdiff_t( width ) ) + dx );
+            t.kernel = kernel[ky] * kernel[kx];
+
+            accumulate( in, t, begin, end, weights, sums );
+        }
+    }
+
+    for ( int x = 0; x < width; ++x ) {
+        for ( int c = 0; c < 3; ++c ) {
+            in.output[c][( size_t( y ) * width ) + x] = sums[c][x] / weights[x];
+        }
+    }
+}
+
+} // namespace denoise_detail
+
+/*
+ * Denoise the averages of «image» with an edge-avoiding à-trous wavelet
+ * (Dammertz, Sewtz, Hanika and Lensch, "Edge-Avoiding À-Trous Wavelet
+ * Transform for fast Global Illumination Filtering", 2010): a 5x5 B-spline
+ * kernel applied «iterations» times with taps 1, 2, 4, ... pixels apart, each
+ * neighbour weighted down by how much it differs from the pixel in colour
+ * and in the «guides».
+ *
+ * The albedo is divided out first and multiplied back at the end, so texture
+ * survives however much the lighting is smoothed.  As in SVGF, colour
+ * differences are measured against the pixel's noise: the film keeps no
+ * second moments, so the variance is taken over the pixel's neighbourhood,
+ * weighted by the guides alone.  Rows are filtered in parallel on «pool»;
+ * the result has one sample per pixel.
+ */
+inline film denoise_film( const film& image, const guide_buffers& guides, thread_pool& pool,
+                          const denoise_settings& settings = denoise_settings() )
+{
+    using namespace denoise_detail;
+
+    const int    width  = image.width, height = image.height;
+    const size_t pixels = size_t( width ) * height;
+    const float  floor  = 1e-3f;        /* Least albedo divided out, so black surfaces stay finite */
+
+    std::vector<float> ping[3], pong[3], squares[3], moments[3];
+    std::vector<float> variance( pixels ), inv_color( pixels, 0 );
+    for ( int c = 0; c < 3; ++c ) {
+        ping[c].resize( pixels );
+        pong[c].resize( pixels );
+        squares[c].resize( pixels );
+        moments[c].resize( pixels );
+    }
+
+    pool.parallel_for( size_t( height ), [&]( size_t y ) {
+        for ( size_t pixel = y * width; pixel < ( y + 1 ) * width; ++pixel ) {
+            color c = image.average( pixel );
+            for ( int k = 0; k < 3; ++k ) {
+                ping[k][pixel]    = float( c[k] ) / std::max( guides.albedo[k][pixel], floor );
+                squares[k][pixel] = ping[k][pixel] * ping[k][pixel];
+            }
+        }
+    } );
+
+    planes in;
+    for ( int c = 0; c < 3; ++c ) {
+        in.albedo[c] = guides.albedo[c].data();
+        in.normal[c] = guides.normal[c].data();
+    }
+    in.depth     = guides.depth.data();
+    in.inv_color = inv_color.data();
+
+    auto pass = [&]( std::vector<float>* from, std::vector<float>* to, int step ) {
+        for ( int c = 0; c < 3; ++c ) {
+            in.color[c]  = from[c].data();
+            in.output[c] = to[c].data();
+        }
+
+        pool.parallel_for( size_t( height ), [&]( size_t y ) {
+            static thread_local std::vector<float> scratch;
+            filter_row( in, width, height, int( y ), step, settings, scratch );
+        } );
+    };
+
+    /* Local mean and mean square, weighted by the guides alone while the colour weights are still zero */
+    pass( ping, pong, 1 );
+    pass( squares, moments, 1 );
+    for ( size_t pixel = 0; pixel < pixels; ++pixel ) {
+        float v = 0;
+        for ( int c = 0; c < 3; ++c ) {
+            v += std::max( 0.0f, moments[c][pixel] - ( pong[c][pixel] * pong[c][pixel] ) );
+        }
+        variance[pixel] = v;
+    }
+    for ( int c = 0; c < 3; ++c ) {
+        squares[c] = std::vector<float>();
+        moments[c] = std::vector<float>();
+    }
+
+    float sigma_color = settings.sigma_color;
+    for ( int iteration = 0; iteration < settings.iterations; ++iteration ) {
+        for ( size_t pixel = 0; pixel < pixels; ++pixel ) {
+            inv_color[pixel] = log2e / ( ( sigma_color * sigma_color * variance[pixel] ) + 1e-6f );
+        }
+
+        pass( ping, pong, 1 << iteration );
+
+        for ( int c = 0; c < 3; ++c ) {
+            std::swap( ping[c], pong[c] );
+        }
+        sigma_color *= 0.5f;
+    }
+
+    film result( width, height );
+    for ( size_t pixel = 0; pixel < pixels; ++pixel ) {
+        color c;
+        for ( int k = 0; k < 3; ++k ) {
+            c[k] = ping[k][pixel] * std::max( guides.albedo[k][pixel], floor );
+        }
+        result.add( pixel, c, 1 );
+    }
+
+    return result;
+}
+
+#endif
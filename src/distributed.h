@@ -0,0 +1,146 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "film.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+/*
+ * Sum the partial films at «paths» into «merged».  Each part may cover any
+ * subset of tiles and samples.
+ */
+inline bool merge_film_parts( const std::vector<std::string>& paths, film& merged )
+{
+    merged = film();
+
+    for ( const auto& path : paths ) {
+        film part;
+        if ( ! part.load( path ) ) {
+            std::cerr << "Error reading film " << path << std::endl;
+            return false;
+        }
+
+        if ( merged.sums.empty() ) {
+            merged = std::move( part );
+        } else if ( part.width != merged.width || part.height != merged.height ) {
+            std::cerr << "Film " << path << " does not match the image size" << std::endl;
+            return false;
+        } else {
+            merged.merge( part );
+        }
+    }
+
+    if ( merged.sums.empty() ) {
+        std::cerr << "No films to merge" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/* Merge the partial films at «paths» and write the result to «output», in the format its extension names */
+inline int merge_films( const std::vector<std::string>& paths, const char* output )
+{
+    film merged;
+    if ( ! merge_film_parts( paths, merged ) ) { return 1; }
+
+    if ( ! merged.write( output ) ) {
+        std::cerr << "Error writing image file " << output << std::endl;
+        return 1;
+    }
+
+    std::clog << "Merged " << paths.size() << " films into " << output << "\n";
+    return 0;
+}
+
+/*
+ * Render locally with «count» worker processes: run «program», looked up
+ * on the PATH like a shell would, once per shard with «--shard i/count
+ * --film part-i.film» plus «extra_args», wait for all of them, then merge
+ * the parts into «merged».  The parts go to a fresh directory under
+ * $TMPDIR, so concurrent renders never share them.  With a «checkpoint»
+ * path each worker also keeps its progress in «checkpoint».part-i, which
+ * outlives a failed render for a later one to resume.
+ */
+inline int launch_workers( const char* program, int count, const std::vector<std::string>& extra_args,
+                           const std::string& checkpoint, film& merged )
+{
+#if defined( __unix__ ) || defined( __APPLE__ )
+    const char* temp_root = std::getenv( "TMPDIR" );
+    std::string directory = std::string( temp_root != nullptr && *temp_root != '\0' ? temp_root : "/tmp" )
+                          + "/rtw-parts-XXXXXX";
+    if ( mkdtemp( &directory[0] ) == nullptr ) {
+        std::cerr << "Error creating a directory for the worker films" << std::endl;
+        return 1;
+    }
+
+    std::vector<pid_t>       workers;
+    std::vector<std::string> parts;
+    int                      failed = 0;
+
+    for ( int shard = 0; shard < count; ++shard ) {
+        parts.push_back( directory + "/part-" + std::to_string( shard ) + ".film" );
+
+        std::vector<std::string> args = { program,
+                                          "--shard", std::to_string( shard ) + "/" + std::to_string( count ),
+                                          "--film",  parts.back() };
+        args.insert( args.end(), extra_args.begin(), extra_args.end() );
+        if ( ! checkpoint.empty() ) {
+            args.push_back( "--checkpoint" );
+            args.push_back( checkpoint + ".part-" + std::to_string( shard ) );
+        }
+
+        std::vector<char*> argv;
+        for ( auto& arg : args ) { argv.push_back( &arg[0] ); }
+        argv.push_back( nullptr );
+
+        pid_t pid;
+        if ( posix_spawnp( &pid, program, nullptr, nullptr, argv.data(), environ ) != 0 ) {
+            std::cerr << "Error starting worker " << shard << std::endl;
+            failed = count - shard;
+            break;
+        }
+        workers.push_back( pid );
+    }
+
+    /* Wait for every worker that started, even when a later one did not */
+    for ( auto pid : workers ) {
+        int status;
+        if ( waitpid( pid, &status, 0 ) < 0 || ! WIFEXITED( status ) || WEXITSTATUS( status ) != 0 ) {
+            ++failed;
+        }
+    }
+
+    bool merged_parts = failed == 0 && merge_film_parts( parts, merged );
+
+    for ( const auto& part : parts ) { std::remove( part.c_str() ); }
+    rmdir( directory.c_str() );
+
+    if ( failed > 0 ) {
+        std::cerr << failed << " of " << count << " workers failed" << std::endl;
+        return 1;
+    }
+    if ( ! merged_parts ) { return 1; }
+
+    std::clog << "Merged " << parts.size() << " films\n";
+
+    return 0;
+#else
+    std::cerr << "Launching local workers is not supported on this platform" << std::endl;
+    return 1;
+#endif
+}
+
+#endif
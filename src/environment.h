@@ -0,0 +1,178 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include "rtweekend.h"
+#include "color.h"
+#include "sampling.h"
+#include "vec3.h"
+
+#include "stb_include.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Light arriving from infinitely far away, as an equirectangular map: the
+ * map's u runs once around the horizon, starting and ending at +z with -z in
+ * the middle, and v runs from +y at the top row to -y at the bottom.
+ *
+ * Directions are importance sampled from a piecewise-constant density over
+ * the pixels, each in proportion to its luminance times the solid angle it
+ * covers, through one alias table over the whole map: a sample costs two
+ * lookups however large or peaked the map.  The density evaluates exactly
+ * to what «sample» draws from, as multiple importance sampling needs.
+ */
+class environment_map
+{
+public:
+    environment_map() = default;
+
+    /* HDR or LDR image at «path», through stb_image; LDR pixels are linearised */
+    bool load( const std::string& path, double intensity = 1 )
+    {
+        int    w = 0, h = 0, channels = 0;
+        float* data = stbi_loadf( path.c_str(), &w, &h, &channels, 3 );
+        if ( data == nullptr ) {
+            std::cerr << "Cannot load environment map " << path << ": " << stbi_failure_reason() << '\n';
+            return false;
+        }
+
+        std::vector<float> rgb( data, data + ( size_t( w ) * h * 3 ) );
+        stbi_image_free( data );
+
+        assign( w, h, std::move( rgb ), intensity );
+        return true;
+    }
+
+    /* Linear RGB rows, top row first, scaled by «intensity» */
+    void assign( int w, int h, std::vector<float> rgb, double intensity = 1 )
+    {
+        width  = w;
+        height = h;
+        pixels = std::move( rgb );
+
+        for ( float& value : pixels ) {
+            value = std::max( 0.0f, float( value * intensity ) );
+        }
+
+        std::vector<double> weights( size_t( width ) * height );
+        for ( int y = 0; y < height; ++y ) {
+            for ( int x = 0; x < width; ++x ) {
+                weights[( size_t( y ) * width ) + x] = weight( x, y );
+            }
+        }
+
+        table = alias_table( weights );
+    }
+
+    bool empty( void ) const { return pixels.empty(); }
+
+    /* False for a black map, which has nothing to sample */
+    bool can_sample( void ) const { return ! table.empty(); }
+
+    color radiance( const vec3& direction ) const
+    {
+        if ( empty() ) { return color( 0, 0, 0 ); }
+
+        int x, y;
+        pixel_of( direction, x, y );
+
+        return texel( x, y );
+    }
+
+    /*
+     * Unit direction towards the map drawn from (u1, u2), with its density
+     * per unit solid angle in «pdf» and its radiance as the result.  «pdf» is
+     * 0 at the poles, where the mapping degenerates; drop such samples.
+     */
+    color sample( double u1, double u2, vec3& direction, double& pdf ) const
+    {
+        double        u     = 0;
+        std::uint32_t index = table.sample( u1, u );
+
+        int x = int( index % std::uint32_t( width ) );
+        int y = int( index / std::uint32_t( width ) );
+
+        double phi       = 2 * pi * ( ( ( x + u ) / width ) - 0.5 );
+        double theta     = pi * ( y + u2 ) / height;
+        double sin_theta = std::sin( theta );
+
+        direction = vec3( real( sin_theta * std::sin( phi ) ), real( std::cos( theta ) ),
+                          real( -sin_theta * std::cos( phi ) ) );
+        pdf       = density( x, y, sin_theta );
+
+        return texel( x, y );
+    }
+
+    /* Density of «sample» drawing «direction», per unit solid angle */
+    double pdf( const vec3& direction ) const
+    {
+        if ( ! can_sample() ) { return 0; }
+
+        int  x, y;
+        vec3 d = unit_vector( direction );
+        pixel_of( d, x, y );
+
+        double sin_theta = std::sqrt( std::max( 0.0, 1 - ( double( d.y() ) * d.y() ) ) );
+
+        return density( x, y, sin_theta );
+    }
+
+    int map_width( void ) const  { return width; }
+    int map_height( void ) const { return height; }
+
+    /* Bytes of the pixels and the alias table */
+    size_t footprint( void ) const
+    {
+        return ( pixels.size() * sizeof( float ) ) + ( table.size() * ( sizeof( float ) + sizeof( std::uint32_t ) ) );
+    }
+
+private:
+    int                width  = 0;
+    int                height = 0;
+    std::vector<float> pixels;
+    alias_table        table;
+
+    color texel( int x, int y ) const
+    {
+        const float* p = &pixels[( ( size_t( y ) * width ) + x ) * 3];
+
+        return color( real( p[0] ), real( p[1] ), real( p[2] ) );
+    }
+
+    /* Luminance times sin θ at the row's centre, in proportion to the pixel's solid angle */
+    double weight( int x, int y ) const
+    {
+        color c = texel( x, y );
+
+        return ( ( 0.2126 * c.x() ) + ( 0.7152 * c.y() ) + ( 0.0722 * c.z() ) ) * std::sin( pi * ( y + 0.5 ) / height );
+    }
+
+    /*
+     * The pixel's share of the total weight spread evenly over its part of
+     * the map, over the solid angle dω = 2π² sin θ du dv that maps onto it.
+     */
+    double density( int x, int y, double sin_theta ) const
+    {
+        if ( ! ( sin_theta > 0 ) ) { return 0; }
+
+        return ( weight( x, y ) / table.total() ) * double( width ) * height / ( 2 * pi * pi * sin_theta );
+    }
+
+    void pixel_of( const vec3& direction, int& x, int& y ) const
+    {
+        vec3   d = unit_vector( direction );
+        double u = 0.5 + ( std::atan2( double( d.x() ), double( -d.z() ) ) / ( 2 * pi ) );
+        double v = std::acos( std::clamp( double( d.y() ), -1.0, 1.0 ) ) / pi;
+
+        x = std::clamp( int( u * width ), 0, width - 1 );
+        y = std::clamp( int( v * height ), 0, height - 1 );
+    }
+};
+
+#endif
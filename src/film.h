@@ -0,0 +1,234 @@
+#ifndef FILM_H
+#define FILM_H
+
+#include "color.h"
+
+#include "stb_include.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+/*
+ * HDR accumulation buffer: the radiance sum and the sample count of every
+ * pixel.  Tiles touch disjoint pixels, so threads can add to it concurrently;
+ * each tile sums its samples locally and adds them once per pass.
+ */
+class film
+{
+public:
+    int width  = 0;
+    int height = 0;
+
+    std::vector<color_sum>     sums;
+    std::vector<std::uint32_t> counts;
+
+    film() {}
+
+    film( int width, int height )
+        : width( width ), height( height ),
+          sums( size_t( width ) * height, color_sum( 0, 0, 0 ) ),
+          counts( size_t( width ) * height, 0 ) {}
+
+    void add( size_t pixel, const color& radiance_sum, int samples )
+    {
+        sums[pixel]   += color_sum( radiance_sum );
+        counts[pixel] += samples;
+    }
+
+    color average( size_t pixel ) const
+    {
+        return counts[pixel] > 0 ? color( sums[pixel] * ( 1.0 / counts[pixel] ) ) : color( 0, 0, 0 );
+    }
+
+    /* Gamma-corrected 8-bit RGB of the pixel averages */
+    std::vector<unsigned char> to_rgb8( void ) const
+    {
+        std::vector<unsigned char> pixels( sums.size() * 3 );
+
+        for ( size_t pixel = 0; pixel < sums.size(); ++pixel ) {
+            write_color( pixels, pixel * 3, average( pixel ) );
+        }
+
+        return pixels;
+    }
+
+    /* Linear RGB of the pixel averages in rows [«row_begin», «row_end»), as 32-bit floats */
+    void average_rows( int row_begin, int row_end, std::vector<float>& rgb ) const
+    {
+        rgb.resize( size_t( row_end - row_begin ) * width * 3 );
+
+        size_t first = size_t( row_begin ) * width;
+        for ( size_t pixel = first; pixel < size_t( row_end ) * width; ++pixel ) {
+            color c = average( pixel );
+            for ( int channel = 0; channel < 3; ++channel ) {
+                rgb[( ( pixel - first ) * 3 ) + channel] = float( c[channel] );
+            }
+        }
+    }
+
+    /*
+     * Write the pixel averages to «path», in the format its extension names:
+     *
+     *     .hdr  Radiance RGBE, through stb
+     *     .pfm  Portable float map: 32-bit float RGB, rows bottom to top
+     *     .raw  32-bit float RGB in native byte order, rows top to bottom,
+     *           no header
+     *     else  PNG, gamma-corrected to 8 bits
+     *
+     * PFM and raw files are streamed a row at a time; only PNG and Radiance
+     * need the whole image converted first.
+     */
+    bool write( const std::string& path ) const
+    {
+        if ( has_extension( path, ".hdr" ) ) { return write_hdr( path.c_str() ); }
+        if ( has_extension( path, ".pfm" ) ) { return write_float_rows( path, true ); }
+        if ( has_extension( path, ".raw" ) ) { return write_float_rows( path, false ); }
+
+        return write_png( path.c_str() );
+    }
+
+    bool write_png( const char* filename ) const
+    {
+        auto pixels = to_rgb8();
+
+        return stbi_write_png( filename, width, height, 3, pixels.data(), width * 3 ) != 0;
+    }
+
+    bool write_hdr( const char* filename ) const
+    {
+        std::vector<float> rgb;
+        average_rows( 0, height, rgb );
+
+        return stbi_write_hdr( filename, width, height, 3, rgb.data() ) != 0;
+    }
+
+    /*
+     * Add the samples of «other», a film of the same size, to this one.  Sums
+     * and counts both add up, so every pixel's average is weighted by the
+     * samples each part contributed.
+     */
+    void merge( const film& other )
+    {
+        for ( size_t pixel = 0; pixel < sums.size(); ++pixel ) {
+            sums[pixel]   += other.sums[pixel];
+            counts[pixel] += other.counts[pixel];
+        }
+    }
+
+    /*
+     * Binary checkpoint, in native byte order:
+     *
+     *     "RTWFILM\0"  u32 version  u32 width  u32 height
+     *     u32 counts[width * height]
+     *     f64 sums[width * height][3]
+     *
+     * Sums are kept in full precision, so resuming loses nothing.  The file is
+     * written next to «path» first and renamed over it, so an interrupted save
+     * leaves the previous checkpoint intact.
+     */
+    bool save( const std::string& path ) const
+    {
+        std::string temp_path = path + ".tmp";
+
+        {
+            std::ofstream out( temp_path, std::ios::binary | std::ios::trunc );
+            if ( ! out ) { return false; }
+
+            std::uint32_t header[3] = { file_version, std::uint32_t( width ), std::uint32_t( height ) };
+            out.write( file_magic, sizeof( file_magic ) );
+            out.write( reinterpret_cast<const char*>( header ), sizeof( header ) );
+            out.write( reinterpret_cast<const char*>( counts.data() ),
+                       std::streamsize( counts.size() * sizeof( std::uint32_t ) ) );
+            out.write( reinterpret_cast<const char*>( sums.data() ),
+                       std::streamsize( sums.size() * sizeof( color_sum ) ) );
+
+            if ( ! out.flush() ) { return false; }
+        }
+
+        return std::rename( temp_path.c_str(), path.c_str() ) == 0;
+    }
+
+    bool load( const std::string& path )
+    {
+        std::ifstream in( path, std::ios::binary );
+        if ( ! in ) { return false; }
+
+        char          magic[sizeof( file_magic )];
+        std::uint32_t header[3];
+        in.read( magic, sizeof( magic ) );
+        in.read( reinterpret_cast<char*>( header ), sizeof( header ) );
+
+        if ( ! in || std::memcmp( magic, file_magic, sizeof( magic ) ) != 0 || header[0] != file_version ) {
+            return false;
+        }
+
+        /* The pixels must fill the rest of the file exactly, checked before allocating for them */
+        std::streamoff header_end = in.tellg();
+        in.seekg( 0, std::ios::end );
+        std::uint64_t  pixel_bytes = std::uint64_t( std::streamoff( in.tellg() ) - header_end );
+        in.seekg( header_end );
+
+        constexpr std::uint64_t bytes_per_pixel = sizeof( std::uint32_t ) + sizeof( color_sum );
+        constexpr std::uint32_t max_side        = std::numeric_limits<int>::max();
+        if ( ! in || header[1] > max_side || header[2] > max_side
+             || std::uint64_t( header[1] ) * header[2] * bytes_per_pixel != pixel_bytes ) {
+            return false;
+        }
+
+        *this = film( int( header[1] ), int( header[2] ) );
+        in.read( reinterpret_cast<char*>( counts.data() ),
+                 std::streamsize( counts.size() * sizeof( std::uint32_t ) ) );
+        in.read( reinterpret_cast<char*>( sums.data() ),
+                 std::streamsize( sums.size() * sizeof( color_sum ) ) );
+
+        return bool( in );
+    }
+
+private:
+    static bool has_extension( const std::string& path, const char* extension )
+    {
+        size_t length = std::strlen( extension );
+
+        return path.size() >= length && path.compare( path.size() - length, length, extension ) == 0;
+    }
+
+    /*
+     * Rows of float RGB, converted and written one at a time.  A PFM file
+     * starts with a header whose negative scale marks little-endian data,
+     * and stores the bottom row first.
+     */
+    bool write_float_rows( const std::string& path, bool pfm ) const
+    {
+        std::ofstream out( path, std::ios::binary | std::ios::trunc );
+        if ( ! out ) { return false; }
+
+        if ( pfm ) {
+            const std::uint16_t probe = 1;
+            bool little_endian = *reinterpret_cast<const unsigned char*>( &probe ) == 1;
+
+            out << "PF\n" << width << ' ' << height << '\n' << ( little_endian ? "-1.0" : "1.0" ) << '\n';
+        }
+
+        std::vector<float> row;
+        for ( int i = 0; i < height; ++i ) {
+            int y = pfm ? height - 1 - i : i;
+
+            average_rows( y, y + 1, row );
+            out.write( reinterpret_cast<const char*>( row.data() ), std::streamsize( row.size() * sizeof( float ) ) );
+        }
+
+        return bool( out.flush() );
+    }
+
+    static constexpr char          file_magic[8] = { 'R', 'T', 'W', 'F', 'I', 'L', 'M', '\0' };
+    static constexpr std::uint32_t file_version  = 1;
+
+    static_assert( sizeof( color_sum ) == 3 * sizeof( double ), "film files store colors as three doubles" );
+};
+
+#endif
@@ -2,20 +2,28 @@
 #define HITTABLE_H
 
 #include "rtweekend.h"
+#include "aabb.h"
 #include "interval.h"
 #include "ray.h"
+#include "ray_packet.h"
 #include <memory>
+#include <type_traits>
 
 class material;
 
+/*
+ * Plain data, copied freely on the hot path: «mat» points into storage owned
+ * by the scene (see «scene»), which outlives every render.
+ */
 class hit_record
 {
 public:
-    point3               p;
-    vec3                 normal;
-    shared_ptr<material> mat;
-    double               t;
-    bool                 front_face;
+    point3          p;
+    vec3            normal;
+    const material* mat;
+    real            t;
+    real            p_error;    /* Bound on the rounding error of each coordinate of «p» */
+    bool            front_face;
 
     void set_face_normal( const ray& r, const vec3& outward_normal )
     {
@@ -24,14 +32,48 @@ public:
         front_face = dot( r.direction(), outward_normal ) < 0;
         normal     = front_face ? outward_normal : -outward_normal;
     }
+
+    /*
+     * Ray leaving the surface along «direction».  Its origin is pushed off
+     * the surface, to the side the ray leaves on, by more than the error in
+     * «p», so the ray cannot find the same surface again at t = 0 and the
+     * trace needs no epsilon on t.
+     */
+    ray spawn_ray( const vec3& direction ) const
+    {
+        real offset = p_error * ( std::fabs( normal.x() ) + std::fabs( normal.y() ) + std::fabs( normal.z() ) );
+
+        return ray( p + ( dot( direction, normal ) > 0 ? offset : -offset ) * normal, direction );
+    }
 };
 
+/* Range of t searched along every ray; see «hit_record::spawn_ray» */
+const interval ray_interval = interval( 0, infinity );
+
 class hittable
 {
 public:
     virtual ~hittable() = default;
 
+    /* Closest hit within «ray_t»; «rec» is left untouched on a miss */
     virtual bool hit( const ray& r, interval ray_t, hit_record& rec ) const = 0;
+
+    virtual aabb bounding_box() const = 0;
+
+    /*
+     * Closest hit for every ray of «packet».  Acceleration structures override
+     * this to traverse with the whole packet; by default rays go one by one.
+     */
+    virtual void hit_packet( const ray_packet& packet, interval ray_t,
+                             hit_record* recs, bool* hits ) const
+    {
+        for ( int lane = 0; lane < packet.count; ++lane ) {
+            hits[lane] = hit( packet.rays[lane], ray_t, recs[lane] );
+        }
+    }
 };
 
+static_assert( std::is_trivially_copyable<hit_record>::value,
+               "hit_record is copied on every closer hit" );
+
 #endif
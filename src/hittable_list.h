@@ -17,29 +17,66 @@ public:
     hittable_list() {}
     hittable_list( shared_ptr<hittable> object ) { add( object ); }
 
-    void clear() { objects.clear(); }
+    void clear()
+    {
+        objects.clear();
+        bbox = aabb();
+    }
 
     void add( shared_ptr<hittable> object )
     {
         objects.push_back( object );
+        bbox = aabb( bbox, object->bounding_box() );
     }
 
     bool hit( const ray& r, interval ray_t, hit_record& rec ) const override
     {
-        hit_record temp_rec;
-        bool       hit_something = false;
-        auto       closest       = ray_t.max;
+        bool hit_something = false;
+        auto closest       = ray_t.max;
 
+        RTW_STAT( stats::local().list_tests += objects.size() );
+
+        /* A miss leaves «rec» alone, so each closer hit can write it directly */
         for ( const auto& object : objects ) {
-            if ( object->hit( r, interval( ray_t.min, closest ), temp_rec ) ) {
+            if ( object->hit( r, interval( ray_t.min, closest ), rec ) ) {
                 hit_something = true;
-                closest = temp_rec.t;
-                rec = temp_rec;
+                closest = rec.t;
             }
         }
 
         return hit_something;
     }
+
+    /*
+     * Each object traces the whole packet against the full interval; keeping
+     * only strictly closer hits gives the same result as «hit» per lane.
+     */
+    void hit_packet( const ray_packet& packet, interval ray_t,
+                     hit_record* recs, bool* hits ) const override
+    {
+        hit_record temp_recs[ray_packet::size];
+        bool       temp_hits[ray_packet::size];
+
+        for ( int lane = 0; lane < packet.count; ++lane ) {
+            hits[lane] = false;
+        }
+
+        for ( const auto& object : objects ) {
+            object->hit_packet( packet, ray_t, temp_recs, temp_hits );
+
+            for ( int lane = 0; lane < packet.count; ++lane ) {
+                if ( temp_hits[lane] && ( ! hits[lane] || temp_recs[lane].t < recs[lane].t ) ) {
+                    hits[lane] = true;
+                    recs[lane] = temp_recs[lane];
+                }
+            }
+        }
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    aabb bbox;
 };
 
 #endif
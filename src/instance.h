@@ -0,0 +1,207 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "rtweekend.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+#include "scene.h"
+#include "transform.h"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/*
+ * A shared, already built hierarchy placed in the world by a transform.
+ * Rays are taken into the hierarchy's own space and hits brought back, so
+ * any number of instances cost one copy of the geometry.  The hierarchy
+ * must outlive the instance.
+ */
+class instance : public hittable
+{
+public:
+    instance( const linear_bvh& object, const transform& placement )
+        : object( &object ), placement( placement ), bbox( placement.box( object.bounding_box() ) )
+    {}
+
+    bool hit( const ray& r, interval ray_t, hit_record& rec ) const override
+    {
+        return hit_with( r, ray_t, rec, [this]( const ray& local, interval ray_t, hit_record& rec ) {
+            return object->hit( local, ray_t, rec );
+        } );
+    }
+
+    /* «hit» for a hierarchy of «Primitive»s only, without virtual calls */
+    template <typename Primitive>
+    bool hit_as( const ray& r, interval ray_t, hit_record& rec ) const
+    {
+        return hit_with( r, ray_t, rec, [this]( const ray& local, interval ray_t, hit_record& rec ) {
+            return object->hit_as<Primitive>( local, ray_t, rec );
+        } );
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    const linear_bvh* object;
+    transform         placement;
+    aabb              bbox;
+
+    template <typename LocalHit>
+    bool hit_with( const ray& r, interval ray_t, hit_record& rec, const LocalHit& local_hit ) const
+    {
+        /* The transform keeps t, so «ray_t» and the hit's t carry over unchanged */
+        if ( ! local_hit( placement.to_local( r ), ray_t, rec ) ) {
+            return false;
+        }
+
+        /*
+         * The point's error grows by the transform's gain, along with the
+         * error of taking a world point back to local space, which a ray
+         * spawned from it goes through; then the transform rounds once more.
+         */
+        point3 p    = placement.point( rec.p );
+        rec.p_error = ( placement.gain() * ( rec.p_error + placement.local_point_error( p ) ) )
+                      + placement.point_error( rec.p );
+        rec.p       = p;
+
+        /* «front_face» holds on both sides: d · n does not change under the transform */
+        rec.normal = unit_vector( placement.normal( rec.normal ) );
+
+        return true;
+    }
+};
+
+template <typename Primitive>
+class typed_instances;
+
+using prototype_id = std::uint32_t;
+
+/*
+ * Two-level scene: compiled sub-scenes, the prototypes, placed any number of
+ * times by instances, with a hierarchy over the instances on top.  Add the
+ * prototypes and instances, then «build» before tracing.
+ */
+class instanced_scene
+{
+public:
+    prototype_id add_prototype( std::unique_ptr<const compiled_scene> prototype )
+    {
+        prototypes.push_back( std::move( prototype ) );
+        return prototype_id( prototypes.size() - 1 );
+    }
+
+    void add_instance( prototype_id prototype, const transform& placement )
+    {
+        instances.emplace_back( prototypes[prototype]->hierarchy(), placement );
+        sphere_total += prototypes[prototype]->sphere_count();
+    }
+
+    /* Build the top-level hierarchy, putting the instances in its leaf order */
+    void build( void )
+    {
+        std::vector<bvh_primitive> prims( instances.size() );
+        for ( size_t i = 0; i < instances.size(); ++i ) {
+            prims[i].box      = instances[i].bounding_box();
+            prims[i].centroid = prims[i].box.centroid();
+            prims[i].index    = i;
+        }
+
+        aabb bounds = bvh_bounds( prims, 0, prims.size() );
+        nodes       = linear_bvh::build_nodes( prims );
+
+        std::vector<instance> ordered;
+        ordered.reserve( instances.size() );
+        leaves.clear();
+        for ( const auto& prim : prims ) {
+            ordered.push_back( instances[prim.index] );
+        }
+        instances = std::move( ordered );
+
+        for ( const auto& placed : instances ) {
+            leaves.push_back( &placed );
+        }
+
+        top = std::make_unique<linear_bvh>( nodes.data(), nodes.size(), leaves.data(), bounds );
+    }
+
+    const hittable& world( void ) const { return *top; }
+
+    /* The same world for closed-world integrators, when every prototype is made of «Primitive»s */
+    template <typename Primitive>
+    typed_instances<Primitive> typed_world( void ) const;
+
+    /* Spheres in the world, counting every instance's copies */
+    size_t sphere_count( void ) const   { return sphere_total; }
+    size_t instance_count( void ) const { return instances.size(); }
+
+    /* Bytes of the prototypes, instances and top-level hierarchy */
+    size_t footprint( void ) const
+    {
+        size_t bytes = ( instances.size() * ( sizeof( instance ) + sizeof( const hittable* ) ) )
+                       + ( nodes.size() * sizeof( linear_bvh_node ) );
+        for ( const auto& prototype : prototypes ) {
+            bytes += prototype->footprint();
+        }
+
+        return bytes;
+    }
+
+    void report( std::ostream& out ) const
+    {
+        out << "Scene: " << footprint() << " bytes for " << sphere_total << " spheres ("
+            << prototypes.size() << " prototypes, " << instances.size() << " instances, "
+            << nodes.size() << " top-level nodes)\n";
+    }
+
+private:
+    template <typename Primitive>
+    friend class typed_instances;
+
+    std::vector<std::unique_ptr<const compiled_scene>> prototypes;
+    std::vector<instance>                              instances;
+    std::vector<const hittable*>                       leaves;
+    std::vector<linear_bvh_node>                       nodes;
+    std::unique_ptr<linear_bvh>                        top;
+    size_t                                             sphere_total = 0;
+};
+
+/* Closed-world view of an «instanced_scene»: no virtual call at either level */
+template <typename Primitive>
+class typed_instances
+{
+public:
+    explicit typed_instances( const instanced_scene& world ) : top( *world.top ), instances( world.instances.data() ) {}
+
+    bool hit( const ray& r, interval ray_t, hit_record& rec ) const
+    {
+        return top.hit_leaves( r, ray_t, rec, [this]( std::uint32_t index, const ray& r, interval ray_t,
+                                                      hit_record& rec ) {
+            return instances[index].template hit_as<Primitive>( r, ray_t, rec );
+        } );
+    }
+
+    /* Packets share the top-level traversal; each ray goes through an instance on its own */
+    void hit_packet( const ray_packet& packet, interval ray_t, hit_record* recs, bool* hits ) const
+    {
+        top.hit_packet_leaves( packet, ray_t, recs, hits, [this]( std::uint32_t index, const ray& r,
+                                                                  interval ray_t, hit_record& rec ) {
+            return instances[index].template hit_as<Primitive>( r, ray_t, rec );
+        } );
+    }
+
+private:
+    const linear_bvh& top;
+    const instance*   instances;
+};
+
+template <typename Primitive>
+typed_instances<Primitive> instanced_scene::typed_world( void ) const
+{
+    return typed_instances<Primitive>( *this );
+}
+
+#endif
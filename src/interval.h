@@ -3,31 +3,36 @@
 
 #include "constants.h"
 
-class interval
+template <typename T>
+class interval_t
 {
 public:
-    double min, max;
+    T min, max;
 
-    interval() : min( +infinity ), max( -infinity ) {}
+    interval_t() : min( +infinity ), max( -infinity ) {}
 
-    interval( double min, double max ) : min( min ), max( max ) {}
+    interval_t( T min, T max ) : min( min ), max( max ) {}
 
-    double size() const
+    /* The tightest interval enclosing both «a» and «b» */
+    interval_t( const interval_t& a, const interval_t& b )
+        : min( a.min <= b.min ? a.min : b.min ), max( a.max >= b.max ? a.max : b.max ) {}
+
+    T size() const
     {
         return max - min;
     }
 
-    bool contains( double x ) const
+    bool contains( T x ) const
     {
         return min <= x && x <= max;
     }
 
-    bool surrounds( double x ) const
+    bool surrounds( T x ) const
     {
         return min < x && x < max;
     }
 
-    double clamp( double x ) const
+    T clamp( T x ) const
     {
         if ( x < min ) { return min; }
         if ( x > max ) { return max; }
@@ -35,10 +40,21 @@ public:
         return x;
     }
 
-    static const interval empty, universe;
+    interval_t expand( T delta ) const
+    {
+        auto padding = delta / 2;
+
+        return interval_t( min - padding, max + padding );
+    }
+
+    static const interval_t empty, universe;
 };
 
-const interval interval::empty    = interval( +infinity, -infinity );
-const interval interval::universe = interval( +infinity, -infinity );
+template <typename T>
+const interval_t<T> interval_t<T>::empty    = interval_t<T>( +infinity, -infinity );
+template <typename T>
+const interval_t<T> interval_t<T>::universe = interval_t<T>( -infinity, +infinity );
+
+using interval = interval_t<real>;
 
 #endif
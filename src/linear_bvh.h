@@ -0,0 +1,649 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+ * One node of a «linear_bvh», stored depth-first: the first child of an
+ * interior node immediately follows it, «offset» points at the second.
+ * For a leaf, «offset» is the first of its «count» primitives.
+ */
+struct linear_bvh_node
+{
+    float         bounds_min[3];
+    float         bounds_max[3];
+    std::uint32_t offset;
+    std::uint16_t count;        /* 0 for interior nodes */
+    std::uint8_t  axis;         /* Split axis of an interior node */
+    std::uint8_t  pad;
+};
+
+static_assert( sizeof( linear_bvh_node ) == 32, "linear_bvh_node must stay 32 bytes" );
+
+/*
+ * SAH bounding volume hierarchy flattened into one array of compact nodes.
+ * Traversal is a loop over a small fixed stack that visits the nearer child
+ * first, without a pointer chase or a virtual call per node.
+ */
+class linear_bvh : public hittable
+{
+public:
+    /* Most interior nodes on a path from the root, which bounds the traversal stack */
+    static constexpr int max_depth = 64;
+
+    linear_bvh( const hittable_list& list ) : linear_bvh( list.objects ) {}
+
+    linear_bvh( const std::vector<shared_ptr<hittable>>& objects )
+    {
+        if ( objects.empty() ) { return; }
+
+        auto prims   = bvh_primitives( objects );
+        bbox         = bvh_bounds( prims, 0, prims.size() );
+        node_storage = build_nodes( prims );
+
+        owned.reserve( prims.size() );
+        primitive_storage.reserve( prims.size() );
+        for ( const auto& prim : prims ) {
+            owned.push_back( objects[prim.index] );
+            primitive_storage.push_back( owned.back().get() );
+        }
+
+        nodes      = node_storage.data();
+        nodes_size = node_storage.size();
+        primitives = primitive_storage.data();
+    }
+
+    /*
+     * View over nodes and leaf-ordered primitives stored elsewhere, as made by
+     * «build_nodes»; both arrays must outlive the hierarchy.
+     */
+    linear_bvh( const linear_bvh_node* nodes, size_t node_count,
+                const hittable* const* primitives, const aabb& bbox )
+        : nodes( nodes ), nodes_size( node_count ), primitives( primitives ), bbox( bbox )
+    {}
+
+    /* «nodes» may point into this object's own storage */
+    linear_bvh( const linear_bvh& ) = delete;
+    linear_bvh& operator=( const linear_bvh& ) = delete;
+
+    /* Build the flattened hierarchy over «prims», reordering them into leaf order */
+    static std::vector<linear_bvh_node> build_nodes( std::vector<bvh_primitive>& prims )
+    {
+        std::vector<linear_bvh_node> flat;
+        if ( prims.empty() ) { return flat; }
+
+        unsigned threads = std::max( 1u, std::thread::hardware_concurrency() );
+        int parallel_depth = 0;
+        while ( ( 1u << parallel_depth ) < threads ) { ++parallel_depth; }
+
+        /* Halving below the SAH levels takes up to ⌈log2 n⌉ more, which must fit «max_depth» */
+        int halvings = 0;
+        while ( ( size_t( 1 ) << halvings ) < prims.size() ) { ++halvings; }
+        int sah_limit = std::max( 0, std::min( sah_depth, max_depth - halvings ) );
+
+        auto root = build( prims, 0, prims.size(), bvh_bounds( prims, 0, prims.size() ),
+                           0, sah_limit, parallel_depth + 1 );
+
+        flat.reserve( root->node_count );
+        flatten( *root, flat );
+
+        return flat;
+    }
+
+    /*
+     * Most interior nodes on a path from the root of «nodes», whose interior
+     * nodes must point past themselves to nodes in range.
+     */
+    static int depth( const linear_bvh_node* nodes, size_t count )
+    {
+        if ( count == 0 ) { return 0; }
+
+        /* Children come after their parent, so one backward sweep sees them first */
+        std::vector<int> below( count, 0 );
+        for ( size_t i = count; i-- > 0; ) {
+            if ( nodes[i].count == 0 ) {
+                below[i] = 1 + std::max( below[i + 1], below[nodes[i].offset] );
+            }
+        }
+
+        return below[0];
+    }
+
+    bool hit( const ray& r, interval ray_t, hit_record& rec ) const override
+    {
+        return hit_as<hittable>( r, ray_t, rec );
+    }
+
+    void hit_packet( const ray_packet& packet, interval ray_t,
+                     hit_record* recs, bool* hits ) const override
+    {
+        hit_packet_as<hittable>( packet, ray_t, recs, hits );
+    }
+
+    /*
+     * «hit» for a hierarchy whose primitives are all of type «Primitive»:
+     * leaves call its «hit» directly instead of through the vtable.
+     */
+    template <typename Primitive>
+    bool hit_as( const ray& r, interval ray_t, hit_record& rec ) const
+    {
+        return hit_leaves( r, ray_t, rec, [this]( std::uint32_t index, const ray& r, interval ray_t,
+                                                 hit_record& rec ) {
+            return primitive_hit<Primitive>( primitives[index], r, ray_t, rec );
+        } );
+    }
+
+    /*
+     * Traversal with primitives stored elsewhere: «leaf_hit( index, r, ray_t,
+     * rec )» tests the primitive at «index» in leaf order, like «hit».
+     */
+    template <typename LeafHit>
+    bool hit_leaves( const ray& r, interval ray_t, hit_record& rec, const LeafHit& leaf_hit ) const
+    {
+        return hit_leaf_nodes( r, ray_t, rec, [&leaf_hit]( const linear_bvh_node& leaf, const ray& r,
+                                                           interval ray_t, hit_record& rec ) {
+            return leaf_range_hit( leaf, r, ray_t, rec, leaf_hit );
+        } );
+    }
+
+    /*
+     * Traversal that hands whole leaves over: «leaf_hit( leaf, r, ray_t, rec )»
+     * finds the closest hit among the primitives of the node «leaf» within
+     * «ray_t», like «hit».
+     */
+    template <typename LeafNodeHit>
+    bool hit_leaf_nodes( const ray& r, interval ray_t, hit_record& rec, const LeafNodeHit& leaf_hit ) const
+    {
+        if ( nodes_size == 0 ) { return false; }
+
+        const point3& orig = r.origin();
+        const vec3&   dir  = r.direction();
+        const vec3    inv_dir( 1 / dir.x(), 1 / dir.y(), 1 / dir.z() );
+        const bool    dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+        std::uint32_t stack[max_depth];
+        int           top     = 0;
+        std::uint32_t current = 0;
+        bool          hit_anything = false;
+
+        while ( true ) {
+            const linear_bvh_node& node = nodes[current];
+
+            if ( node_hit( node, orig, inv_dir, ray_t ) ) {
+                if ( node.count > 0 ) {
+                    if ( leaf_hit( node, r, ray_t, rec ) ) {
+                        hit_anything = true;
+                        ray_t.max    = rec.t;
+                    }
+
+                    if ( top == 0 ) { break; }
+                    current = stack[--top];
+                } else if ( dir_is_neg[node.axis] ) {
+                    assert( top < max_depth );
+                    stack[top++] = current + 1;
+                    current      = node.offset;
+                } else {
+                    assert( top < max_depth );
+                    stack[top++] = node.offset;
+                    current      = current + 1;
+                }
+            } else {
+                if ( top == 0 ) { break; }
+                current = stack[--top];
+            }
+        }
+
+        return hit_anything;
+    }
+
+    /*
+     * Packet traversal: a node is entered when any lane hits it.  The lane
+     * that hit most recently is tried first, and when every lane's direction
+     * has the same signs the whole packet is culled at once with interval
+     * bounds over the lanes' origins and inverse directions.
+     */
+    template <typename Primitive>
+    void hit_packet_as( const ray_packet& packet, interval ray_t,
+                        hit_record* recs, bool* hits ) const
+    {
+        hit_packet_leaves( packet, ray_t, recs, hits, [this]( std::uint32_t index, const ray& r,
+                                                              interval ray_t, hit_record& rec ) {
+            return primitive_hit<Primitive>( primitives[index], r, ray_t, rec );
+        } );
+    }
+
+    /* «hit_packet» with primitives stored elsewhere, as for «hit_leaves» */
+    template <typename LeafHit>
+    void hit_packet_leaves( const ray_packet& packet, interval ray_t, hit_record* recs, bool* hits,
+                            const LeafHit& leaf_hit ) const
+    {
+        hit_packet_leaf_nodes( packet, ray_t, recs, hits, [&leaf_hit]( const linear_bvh_node& leaf, const ray& r,
+                                                                       interval ray_t, hit_record& rec ) {
+            return leaf_range_hit( leaf, r, ray_t, rec, leaf_hit );
+        } );
+    }
+
+    /* «hit_packet» handing whole leaves over, as for «hit_leaf_nodes» */
+    template <typename LeafNodeHit>
+    void hit_packet_leaf_nodes( const ray_packet& packet, interval ray_t, hit_record* recs, bool* hits,
+                                const LeafNodeHit& leaf_hit ) const
+    {
+        constexpr int size = ray_packet::size;
+        const int     n    = packet.count;
+
+        for ( int lane = 0; lane < n; ++lane ) { hits[lane] = false; }
+        if ( nodes_size == 0 || n == 0 ) { return; }
+
+        lanes soa;
+        soa.count = n;
+        for ( int lane = 0; lane < size; ++lane ) {
+            if ( lane >= n ) {
+                /* Unused lanes get an empty interval and never hit anything */
+                for ( int axis = 0; axis < 3; ++axis ) {
+                    soa.orig[axis][lane]    = 0;
+                    soa.inv_dir[axis][lane] = 1;
+                }
+                soa.t_max[lane] = -infinity;
+                continue;
+            }
+
+            const ray& r = packet.rays[lane];
+            for ( int axis = 0; axis < 3; ++axis ) {
+                soa.orig[axis][lane]    = r.origin()[axis];
+                soa.inv_dir[axis][lane] = 1 / r.direction()[axis];
+            }
+            soa.t_max[lane] = ray_t.max;
+        }
+
+        frustum cull = packet_frustum( soa );
+        cull.t_max   = ray_t.max;
+
+        const bool dir_is_neg[3] = { soa.inv_dir[0][0] < 0, soa.inv_dir[1][0] < 0, soa.inv_dir[2][0] < 0 };
+
+        std::uint32_t stack[max_depth];
+        int           top     = 0;
+        std::uint32_t current = 0;
+        int           first   = 0;
+
+        while ( true ) {
+            const linear_bvh_node& node = nodes[current];
+
+            bool enter = lane_hit( node, soa, first, ray_t.min );
+            if ( ! enter && ! ( cull.valid && cull.misses( node, ray_t.min ) ) ) {
+                bool lane_mask[size];
+                lanes_hit( node, soa, ray_t.min, lane_mask );
+
+                for ( int lane = 0; lane < n; ++lane ) {
+                    if ( lane_mask[lane] ) {
+                        enter = true;
+                        first = lane;
+                        break;
+                    }
+                }
+            }
+
+            if ( enter ) {
+                if ( node.count > 0 ) {
+                    bool lane_mask[size];
+                    lanes_hit( node, soa, ray_t.min, lane_mask );
+
+                    for ( int lane = 0; lane < n; ++lane ) {
+                        if ( ! lane_mask[lane] ) { continue; }
+
+                        auto lane_t = interval( ray_t.min, soa.t_max[lane] );
+                        if ( leaf_hit( node, packet.rays[lane], lane_t, recs[lane] ) ) {
+                            hits[lane]      = true;
+                            soa.t_max[lane] = recs[lane].t;
+                        }
+                    }
+
+                    cull.t_max = soa.t_max[0];
+                    for ( int lane = 1; lane < n; ++lane ) {
+                        cull.t_max = std::fmax( cull.t_max, soa.t_max[lane] );
+                    }
+
+                    if ( top == 0 ) { break; }
+                    current = stack[--top];
+                } else if ( dir_is_neg[node.axis] ) {
+                    assert( top < max_depth );
+                    stack[top++] = current + 1;
+                    current      = node.offset;
+                } else {
+                    assert( top < max_depth );
+                    stack[top++] = node.offset;
+                    current      = current + 1;
+                }
+            } else {
+                if ( top == 0 ) { break; }
+                current = stack[--top];
+            }
+        }
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t node_count( void ) const { return nodes_size; }
+
+    /* The flattened nodes and the primitives in leaf order, e.g. to lay them out another way */
+    const linear_bvh_node* node_data( void ) const      { return nodes; }
+    const hittable* const* leaf_primitives( void ) const { return primitives; }
+
+private:
+    const linear_bvh_node* nodes      = nullptr;
+    size_t                 nodes_size = 0;
+    const hittable* const* primitives = nullptr;  /* In leaf order */
+    aabb                   bbox;
+
+    /* Storage behind «nodes» and «primitives» when the hierarchy owns them */
+    std::vector<linear_bvh_node>      node_storage;
+    std::vector<const hittable*>      primitive_storage;
+    std::vector<shared_ptr<hittable>> owned;
+
+    /* Closest hit among the primitives of «leaf», one «leaf_hit» at a time */
+    template <typename LeafHit>
+    static bool leaf_range_hit( const linear_bvh_node& leaf, const ray& r, interval ray_t, hit_record& rec,
+                                const LeafHit& leaf_hit )
+    {
+        bool hit_anything = false;
+
+        for ( std::uint32_t i = 0; i < leaf.count; ++i ) {
+            if ( leaf_hit( leaf.offset + i, r, ray_t, rec ) ) {
+                hit_anything = true;
+                ray_t.max    = rec.t;
+            }
+        }
+
+        return hit_anything;
+    }
+
+    template <typename Primitive>
+    static bool primitive_hit( const hittable* object, const ray& r, interval ray_t, hit_record& rec )
+    {
+        if constexpr ( std::is_same<Primitive, hittable>::value ) {
+            return object->hit( r, ray_t, rec );
+        } else {
+            return static_cast<const Primitive*>( object )->Primitive::hit( r, ray_t, rec );
+        }
+    }
+
+    /* Deeper subtrees fall back to median splits, sooner for very large builds */
+    static constexpr int sah_depth = 40;
+
+    static constexpr size_t max_leaf_size      = 4;
+    static constexpr size_t parallel_threshold = 16384;
+
+    /* Temporary pointer tree, flattened once the (parallel) build is done */
+    struct build_node
+    {
+        aabb                        bounds;
+        size_t                      begin, count;
+        int                         axis;
+        size_t                      node_count;
+        std::unique_ptr<build_node> left, right;
+    };
+
+    static std::unique_ptr<build_node> build( std::vector<bvh_primitive>& prims,
+                                              size_t begin, size_t end, const aabb& bounds,
+                                              int depth, int sah_limit, int parallel_depth )
+    {
+        auto node = std::make_unique<build_node>();
+        node->bounds     = bounds;
+        node->begin      = begin;
+        node->count      = end - begin;
+        node->axis       = 0;
+        node->node_count = 1;
+
+        if ( node->count == 1 ) { return node; }
+
+        bvh_split split;
+        if ( depth < sah_limit ) {
+            split = bvh_partition( prims, begin, end, bounds );
+
+            double leaf_cost = node->count * bvh_intersection_cost;
+            if ( node->count <= max_leaf_size && leaf_cost <= split.cost ) {
+                return node;
+            }
+        } else {
+            /* Guarantee termination within «max_depth» by halving */
+            size_t mid = begin + ( node->count / 2 );
+            split = { mid, bounds.longest_axis(), infinity,
+                      bvh_bounds( prims, begin, mid ), bvh_bounds( prims, mid, end ) };
+        }
+
+        node->count = 0;
+        node->axis  = split.axis;
+
+        if ( parallel_depth > 0 && end - begin > parallel_threshold ) {
+            auto left_task = std::async( std::launch::async, [&] {
+                return build( prims, begin, split.mid, split.left, depth + 1, sah_limit, parallel_depth - 1 );
+            } );
+            node->right = build( prims, split.mid, end, split.right, depth + 1, sah_limit, parallel_depth - 1 );
+            node->left  = left_task.get();
+        } else {
+            node->left  = build( prims, begin, split.mid, split.left, depth + 1, sah_limit, 0 );
+            node->right = build( prims, split.mid, end, split.right, depth + 1, sah_limit, 0 );
+        }
+
+        node->node_count += node->left->node_count + node->right->node_count;
+
+        return node;
+    }
+
+    static void flatten( const build_node& node, std::vector<linear_bvh_node>& nodes )
+    {
+        size_t index = nodes.size();
+        nodes.emplace_back();
+
+        auto& flat = nodes[index];
+        for ( int axis = 0; axis < 3; ++axis ) {
+            flat.bounds_min[axis] = round_down( node.bounds.axis_interval( axis ).min );
+            flat.bounds_max[axis] = round_up( node.bounds.axis_interval( axis ).max );
+        }
+        flat.axis = std::uint8_t( node.axis );
+        flat.pad  = 0;
+
+        if ( ! node.left ) {
+            flat.offset = std::uint32_t( node.begin );
+            flat.count  = std::uint16_t( node.count );
+            return;
+        }
+
+        flat.count = 0;
+        flatten( *node.left, nodes );
+        nodes[index].offset = std::uint32_t( nodes.size() );
+        flatten( *node.right, nodes );
+    }
+
+    /* Float bounds must never shrink the double-precision box they store */
+    static float round_down( double x )
+    {
+        float f = float( x );
+        return double( f ) > x ? std::nextafter( f, -std::numeric_limits<float>::infinity() ) : f;
+    }
+
+    static float round_up( double x )
+    {
+        float f = float( x );
+        return double( f ) < x ? std::nextafter( f, std::numeric_limits<float>::infinity() ) : f;
+    }
+
+    /* Structure-of-arrays copy of a packet's rays */
+    struct lanes
+    {
+        double orig[3][ray_packet::size];
+        double inv_dir[3][ray_packet::size];
+        double t_max[ray_packet::size];
+        int    count;
+    };
+
+    /* Interval bounds over all lanes of a packet, used to cull whole nodes */
+    struct frustum
+    {
+        bool   valid;
+        double orig_lo[3], orig_hi[3];
+        double inv_lo[3], inv_hi[3];
+        double t_max;
+
+        /*
+         * True when no lane can hit «node».  Correctly rounded arithmetic is
+         * monotonic, so bounds from the interval endpoints hold for every lane.
+         */
+        bool misses( const linear_bvh_node& node, double t_min ) const
+        {
+            double near = t_min;
+            double far  = t_max;
+
+            for ( int axis = 0; axis < 3; ++axis ) {
+                double to_min_lo = node.bounds_min[axis] - orig_hi[axis];
+                double to_min_hi = node.bounds_min[axis] - orig_lo[axis];
+                double to_max_lo = node.bounds_max[axis] - orig_hi[axis];
+                double to_max_hi = node.bounds_max[axis] - orig_lo[axis];
+
+                double t_0[4] = { to_min_lo * inv_lo[axis], to_min_lo * inv_hi[axis],
+                                  to_min_hi * inv_lo[axis], to_min_hi * inv_hi[axis] };
+                double t_1[4] = { to_max_lo * inv_lo[axis], to_max_lo * inv_hi[axis],
+                                  to_max_hi * inv_lo[axis], to_max_hi * inv_hi[axis] };
+
+                /* Entry is through the min slab for positive directions, the max slab otherwise */
+                const double* entry = inv_lo[axis] > 0 ? t_0 : t_1;
+                const double* exit  = inv_lo[axis] > 0 ? t_1 : t_0;
+
+                near = std::fmax( near, std::fmin( std::fmin( entry[0], entry[1] ),
+                                                   std::fmin( entry[2], entry[3] ) ) );
+                far  = std::fmin( far,  std::fmax( std::fmax( exit[0], exit[1] ),
+                                                   std::fmax( exit[2], exit[3] ) ) );
+            }
+
+            return far <= near;
+        }
+    };
+
+    static frustum packet_frustum( const lanes& soa )
+    {
+        frustum f;
+        f.valid = true;
+
+        for ( int axis = 0; axis < 3; ++axis ) {
+            f.orig_lo[axis] = f.orig_hi[axis] = soa.orig[axis][0];
+            f.inv_lo[axis]  = f.inv_hi[axis]  = soa.inv_dir[axis][0];
+
+            for ( int lane = 1; lane < soa.count; ++lane ) {
+                f.orig_lo[axis] = std::fmin( f.orig_lo[axis], soa.orig[axis][lane] );
+                f.orig_hi[axis] = std::fmax( f.orig_hi[axis], soa.orig[axis][lane] );
+                f.inv_lo[axis]  = std::fmin( f.inv_lo[axis],  soa.inv_dir[axis][lane] );
+                f.inv_hi[axis]  = std::fmax( f.inv_hi[axis],  soa.inv_dir[axis][lane] );
+            }
+
+            /* Mixed signs or axis-parallel lanes: the bounds would be useless */
+            bool same_sign = ( f.inv_lo[axis] > 0 ) == ( f.inv_hi[axis] > 0 );
+            if ( ! same_sign || ! std::isfinite( f.inv_lo[axis] ) || ! std::isfinite( f.inv_hi[axis] ) ) {
+                f.valid = false;
+            }
+        }
+
+        return f;
+    }
+
+    /* Slab test of a single lane, same arithmetic as «node_hit» */
+    static bool lane_hit( const linear_bvh_node& node, const lanes& soa, int lane, double t_min )
+    {
+        double lo = t_min;
+        double hi = soa.t_max[lane];
+
+        for ( int axis = 0; axis < 3; ++axis ) {
+            double t_0 = ( node.bounds_min[axis] - soa.orig[axis][lane] ) * soa.inv_dir[axis][lane];
+            double t_1 = ( node.bounds_max[axis] - soa.orig[axis][lane] ) * soa.inv_dir[axis][lane];
+
+            double t_near = t_0 < t_1 ? t_0 : t_1;
+            double t_far  = t_0 < t_1 ? t_1 : t_0;
+
+            lo = t_near > lo ? t_near : lo;
+            hi = t_far  < hi ? t_far  : hi;
+        }
+
+        return lo < hi;
+    }
+
+    /* Branch-free slab test of every lane at once, so that it vectorizes */
+    static void lanes_hit( const linear_bvh_node& node, const lanes& soa, double t_min, bool* mask )
+    {
+        for ( int lane = 0; lane < ray_packet::size; ++lane ) {
+            double lo = t_min;
+            double hi = soa.t_max[lane];
+
+            for ( int axis = 0; axis < 3; ++axis ) {
+                double t_0 = ( node.bounds_min[axis] - soa.orig[axis][lane] ) * soa.inv_dir[axis][lane];
+                double t_1 = ( node.bounds_max[axis] - soa.orig[axis][lane] ) * soa.inv_dir[axis][lane];
+
+                double t_near = t_0 < t_1 ? t_0 : t_1;
+                double t_far  = t_0 < t_1 ? t_1 : t_0;
+
+                lo = t_near > lo ? t_near : lo;
+                hi = t_far  < hi ? t_far  : hi;
+            }
+
+            mask[lane] = lo < hi;
+        }
+    }
+
+    static bool node_hit( const linear_bvh_node& node, const point3& orig, const vec3& inv_dir,
+                          interval ray_t )
+    {
+        for ( int axis = 0; axis < 3; ++axis ) {
+            auto t_0 = ( node.bounds_min[axis] - orig[axis] ) * inv_dir[axis];
+            auto t_1 = ( node.bounds_max[axis] - orig[axis] ) * inv_dir[axis];
+
+            if ( t_0 < t_1 ) {
+                if ( t_0 > ray_t.min ) { ray_t.min = t_0; }
+                if ( t_1 < ray_t.max ) { ray_t.max = t_1; }
+            } else {
+                if ( t_1 > ray_t.min ) { ray_t.min = t_1; }
+                if ( t_0 < ray_t.max ) { ray_t.max = t_0; }
+            }
+
+            if ( ray_t.max <= ray_t.min ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+/* Closed-world view of a «linear_bvh» built over «Primitive»s only */
+template <typename Primitive>
+class typed_bvh
+{
+public:
+    explicit typed_bvh( const linear_bvh& bvh ) : bvh( bvh ) {}
+
+    bool hit( const ray& r, interval ray_t, hit_record& rec ) const
+    {
+        return bvh.hit_as<Primitive>( r, ray_t, rec );
+    }
+
+    void hit_packet( const ray_packet& packet, interval ray_t, hit_record* recs, bool* hits ) const
+    {
+        bvh.hit_packet_as<Primitive>( packet, ray_t, recs, hits );
+    }
+
+private:
+    const linear_bvh& bvh;
+};
+
+#endif
@@ -1,64 +1,181 @@
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "rtweekend.h"
 
 #include "color.h"
-#include "hittable_list.h"
 #include "material.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "scenes.h"
 #include "sphere.h"
+#include "sphere_soa.h"
 #include "camera.h"
+#include "distributed.h"
+#include "environment.h"
+#include "instance.h"
+#include "mesh_loader.h"
 #include "vec3.h"
 
-int main( void )
+/* Most threads or worker processes a render starts, so a typo cannot start thousands */
+static constexpr int max_threads = 1024;
+
+static void usage( const char* program )
 {
-    hittable_list world;
-
-    auto material_ground = make_shared<lambertian>( color( 0.5, 0.5, 0.5 ) );
-    world.add( make_shared<sphere>( point3( 0, -1000, 0 ), 1000, material_ground ) );
-
-    for ( int a = -11; a < 11; ++a ) {
-        for ( int b = -11; b < 11; ++b ) {
-            auto choose_mat = random_double();
-            point3 center( a + ( 0.9 * random_double() ),
-                           0.2,
-                           b + ( 0.9 * random_double() ) );
-
-            if ( ( center - point3( 4, 0.2, 0 ) ).length() > 0.9 ) {
-                shared_ptr<material> sphere_material;
-
-                if ( choose_mat < 0.8 ) {
-                    /* Diffuse */
-                    auto albedo     = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>( albedo );
-                } else if ( choose_mat < 0.95 ) {
-                    /* Metal */
-                    auto albedo     = color::random( 0.5, 1 );
-                    auto fuzz       = random_double( 0, 0.5 );
-                    sphere_material = make_shared<metal>( albedo, fuzz );
-                } else {
-                    /* Glass */
-                    sphere_material = make_shared<dielectric>( 1.5 );
-                }
-
-                world.add( make_shared<sphere>( center, 0.2, sphere_material ) );
-            }
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --scene FILE       render the binary scene FILE (see scene_convert) instead of the cover\n"
+              << "  --trusted          skip reading every record of the --scene FILE before rendering\n"
+              << "  --instances N      render N×N instanced copies of the cover's small spheres\n"
+              << "  --mesh FILE        render the .obj or .ply mesh FILE on a ground sphere\n"
+              << "  --environment FILE light the scene by the HDR map FILE (equirectangular) instead of the sky\n"
+              << "  --output FILE      write the image to FILE: .png, .hdr, .pfm or .raw (default image.png)\n"
+              << "  --spp N            samples per pixel (default 500, or the --scene FILE's)\n"
+              << "  --denoise          filter the image, guided by first-hit albedo, normal and depth\n"
+              << "  --guides FILE      also write those guides next to FILE, in its format\n"
+              << "  --checkpoint FILE  save progress to FILE, or FILE.part-I for each worker\n"
+              << "  --resume           continue from the checkpoint\n"
+              << "  --threads N        render threads\n"
+              << "  --sampler NAME     independent, sobol or blue-noise\n"
+              << "  --seed N           vary the random numbers of a render\n"
+              << "  --roulette DEPTH   end paths by Russian roulette from bounce DEPTH on\n"
+              << "  --shard I/N        render only shard I of N\n"
+              << "  --shard-samples    shard by sample range instead of by tiles\n"
+              << "  --film FILE        save the accumulation buffer to FILE instead of the image\n"
+              << "  --workers N        render with N local worker processes and merge\n"
+              << "  --merge OUT FILE...  merge saved films into the PNG OUT\n";
+}
+
+int main( int argc, char* argv[] )
+{
+    camera cam;
+    int    workers   = 0;
+    int    spp       = 500;
+    bool   spp_given = false;
+
+    std::string              scene_path;
+    std::string              mesh_path;
+    std::string              environment_path;
+    int                      instance_grid = 0;
+    bool                     trusted       = false;
+    std::vector<std::string> worker_args;
+
+    for ( int arg = 1; arg < argc; ++arg ) {
+        bool has_value = arg + 1 < argc;
+
+        if ( std::strcmp( argv[arg], "--scene" ) == 0 && has_value ) {
+            scene_path = argv[arg + 1];
+            worker_args.push_back( argv[arg] );
+            worker_args.push_back( argv[++arg] );
+        } else if ( std::strcmp( argv[arg], "--trusted" ) == 0 ) {
+            trusted = true;
+            worker_args.push_back( argv[arg] );
+        } else if ( std::strcmp( argv[arg], "--mesh" ) == 0 && has_value ) {
+            mesh_path = argv[arg + 1];
+            worker_args.push_back( argv[arg] );
+            worker_args.push_back( argv[++arg] );
+        } else if ( std::strcmp( argv[arg], "--environment" ) == 0 && has_value ) {
+            environment_path = argv[arg + 1];
+            worker_args.push_back( argv[arg] );
+            worker_args.push_back( argv[++arg] );
+        } else if ( std::strcmp( argv[arg], "--instances" ) == 0 && has_value ) {
+            instance_grid = std::max( 1, std::atoi( argv[arg + 1] ) );
+            worker_args.push_back( argv[arg] );
+            worker_args.push_back( argv[++arg] );
+        } else if ( std::strcmp( argv[arg], "--output" ) == 0 && has_value ) {
+            cam.image_path = argv[++arg];
+        } else if ( std::strcmp( argv[arg], "--spp" ) == 0 && has_value ) {
+            spp       = std::max( 1, std::atoi( argv[arg + 1] ) );
+            spp_given = true;
+            worker_args.push_back( argv[arg] );
+            worker_args.push_back( argv[++arg] );
+        } else if ( std::strcmp( argv[arg], "--denoise" ) == 0 ) {
+            cam.denoise = true;
+        } else if ( std::strcmp( argv[arg], "--guides" ) == 0 && has_value ) {
+            cam.guide_path = argv[++arg];
+        } else if ( std::strcmp( argv[arg], "--checkpoint" ) == 0 && has_value ) {
+            cam.checkpoint_path = argv[++arg];
+        } else if ( std::strcmp( argv[arg], "--resume" ) == 0 ) {
+            cam.resume = true;
+            worker_args.push_back( argv[arg] );
+        } else if ( std::strcmp( argv[arg], "--threads" ) == 0 && has_value ) {
+            cam.thread_count = std::clamp( std::atoi( argv[++arg] ), 0, max_threads );
+        } else if ( std::strcmp( argv[arg], "--sampler" ) == 0 && has_value
+                    && parse_sample_pattern( argv[arg + 1], cam.sampling ) ) {
+            worker_args.push_back( argv[arg] );
+            worker_args.push_back( argv[++arg] );
+        } else if ( std::strcmp( argv[arg], "--seed" ) == 0 && has_value ) {
+            cam.seed = std::uint32_t( std::strtoul( argv[arg + 1], nullptr, 10 ) );
+            worker_args.push_back( argv[arg] );
+            worker_args.push_back( argv[++arg] );
+        } else if ( std::strcmp( argv[arg], "--roulette" ) == 0 && has_value ) {
+            cam.roulette       = true;
+            cam.roulette_depth = std::max( 0, std::atoi( argv[arg + 1] ) );
+            worker_args.push_back( argv[arg] );
+            worker_args.push_back( argv[++arg] );
+        } else if ( std::strcmp( argv[arg], "--shard" ) == 0 && has_value
+                    && std::sscanf( argv[arg + 1], "%d/%d", &cam.shard_index, &cam.shard_count ) == 2
+                    && cam.shard_count > 0 && cam.shard_index >= 0 && cam.shard_index < cam.shard_count ) {
+            ++arg;
+        } else if ( std::strcmp( argv[arg], "--shard-samples" ) == 0 ) {
+            cam.shard_by_samples = true;
+            worker_args.push_back( argv[arg] );
+        } else if ( std::strcmp( argv[arg], "--film" ) == 0 && has_value ) {
+            cam.film_path = argv[++arg];
+        } else if ( std::strcmp( argv[arg], "--workers" ) == 0 && has_value ) {
+            workers = std::clamp( std::atoi( argv[++arg] ), 0, max_threads );
+        } else if ( std::strcmp( argv[arg], "--merge" ) == 0 && has_value ) {
+            const char* output = argv[arg + 1];
+            return merge_films( std::vector<std::string>( argv + arg + 2, argv + argc ), output );
+        } else {
+            usage( argv[0] );
+            return 1;
         }
     }
 
-    auto material_1 = make_shared<dielectric>( 1.5 );
-    world.add( make_shared<sphere>( point3( 0, 1, 0 ), 1.0, material_1 ) );
+    if ( ( cam.shard_count > 1 || ! cam.film_path.empty() ) && ( cam.denoise || ! cam.guide_path.empty() ) ) {
+        std::cerr << "--denoise and --guides need the whole image, not a shard; "
+                  << "render with --workers to denoise the merged image" << std::endl;
+        return 1;
+    }
+
+    film merged;
+    if ( workers > 0 ) {
+        /* Share the cores between the workers */
+        unsigned cores = std::max( 1u, std::thread::hardware_concurrency() );
+        worker_args.push_back( "--threads" );
+        worker_args.push_back( std::to_string( std::max( 1u, cores / workers ) ) );
 
-    auto material_2 = make_shared<lambertian>( color( 0.4, 0.2, 0.1 ) );
-    world.add( make_shared<sphere>( point3( -4, 1, 0 ), 1.0, material_2 ) );
+        if ( int result = launch_workers( argv[0], workers, worker_args, cam.checkpoint_path, merged ) ) {
+            return result;
+        }
 
-    auto material_3 = make_shared<metal>( color( 0.7, 0.6, 0.5 ), 0.0 );
-    world.add( make_shared<sphere>( point3( 4, 1, 0 ), 1.0, material_3 ) );
+        /* The workers kept the checkpoints; this process only merges */
+        cam.checkpoint_path.clear();
+        cam.resume = false;
 
-    camera cam;
+        if ( ! cam.denoise && cam.guide_path.empty() ) {
+            if ( ! merged.write( cam.image_path ) ) {
+                std::cerr << "Error writing image file " << cam.image_path << std::endl;
+                return 1;
+            }
+
+            std::clog << "Done. Image saved as " << cam.image_path << "\n";
+            return 0;
+        }
+
+        /* The guides need the scene: set it up as for a render, which takes the merged samples */
+        cam.rendered_film = &merged;
+    }
 
     cam.aspect_ratio      = 16.0 / 9.0;
     cam.image_width       = 1200;
-    cam.samples_per_pixel = 500;
+    cam.samples_per_pixel = spp;
     cam.max_depth         = 50;
 
     cam.v_fov     = 20;
@@ -69,5 +186,79 @@ int main( void )
     cam.defocus_angle  =  0.6;
     cam.focus_distance = 10.0;
 
-    cam.render(world);
+    cam.packet_primary = true;
+
+    environment_map environment;
+    if ( ! environment_path.empty() ) {
+        if ( ! environment.load( environment_path ) ) { return 1; }
+
+        std::clog << "Environment: " << environment.map_width() << "x" << environment.map_height() << ", "
+                  << environment.footprint() << " bytes\n";
+        cam.environment = &environment;
+    }
+
+    /* Render in passes and keep the accumulated samples on disk */
+    cam.pass_samples        = 25;
+    cam.checkpoint_interval = 60;
+
+    /* Closed world: the scene only has spheres and the standard materials */
+    if ( ! scene_path.empty() ) {
+        mapped_scene mapped;
+        if ( ! mapped.open( scene_path ) ) { return 1; }
+
+        if ( ! trusted && ! mapped.check() ) {
+            std::cerr << "Scene file " << scene_path << " has records out of range or a hierarchy too deep" << std::endl;
+            return 1;
+        }
+
+        mapped.report( std::clog );
+        mapped.apply_camera( cam );
+
+        /* The command line wins over the file */
+        if ( spp_given ) { cam.samples_per_pixel = spp; }
+
+        return cam.render<standard_materials>( mapped.world() );
+    }
+
+    if ( ! mesh_path.empty() ) {
+        mesh_buffers   buffers;
+        mesh_load_info info;
+        if ( ! load_mesh( mesh_path, buffers, info, unsigned( std::max( 0, cam.thread_count ) ) ) ) { return 1; }
+
+        std::clog << "Mesh: " << info.bytes << " bytes read in " << info.seconds << " s ("
+                  << info.megabytes_per_second() << " MB/s)\n";
+
+        lambertian mesh_material( color( 0.6, 0.55, 0.5 ) );
+        lambertian ground_material( color( 0.5, 0.5, 0.5 ) );
+
+        auto mesh = make_shared<triangle_mesh>( std::move( buffers ), &mesh_material );
+        std::clog << "Mesh: " << mesh->footprint() << " bytes for " << mesh->triangle_count() << " triangles ("
+                  << mesh->vertex_count() << " vertices, " << mesh->node_count() << " nodes)\n";
+
+        hittable_list world;
+        mesh_stage( world, mesh, &ground_material, cam );
+
+        return cam.render<standard_materials>( world );
+    }
+
+    if ( instance_grid > 0 ) {
+        instanced_scene instanced;
+        instanced_spheres( instanced, instance_grid );
+        instanced.report( std::clog );
+
+        return cam.render<standard_materials>( instanced.typed_world<sphere>() );
+    }
+
+    scene world;
+    rng   gen;
+
+    random_spheres( world, gen );
+
+    auto compiled = world.compile();
+    compiled->report( std::clog );
+
+    /* Leaves tested a block of spheres at a time; the image is the same */
+    sphere_soa_bvh blocks( compiled->hierarchy() );
+
+    return cam.render<standard_materials>( blocks );
 }
@@ -4,6 +4,7 @@
 #include "hittable.h"
 #include "ray.h"
 #include "color.h"
+#include "sampler.h"
 #include "vec3.h"
 
 class hit_record;
@@ -11,70 +12,109 @@ class hit_record;
 class material
 {
 public:
+    /* Tag of the standard materials below, for «material_set»; 0 for any other */
+    const int kind;
+
+    /* Tags run from 0 to «kind_count» - 1 */
+    static constexpr int kind_count = material_kinds::count;
+
+    material() : kind( material_kinds::other ) {}
     virtual ~material() = default;
 
     virtual bool scatter( const ray& r_in, const hit_record& rec, color& attenuation,
-                          ray& scattered ) const
+                          ray& scattered, sampler& gen ) const
     {
+        RTW_STAT( ++stats::local().scatters[material_kinds::other] );
+
         return false;
     }
+
+    /* Colour of the surface at a hit, for the denoiser's albedo guide */
+    virtual color surface_albedo( const hit_record& ) const
+    {
+        return color( 0, 0, 0 );
+    }
+
+    /*
+     * Whether the surface is a mirror or clear glass, which the denoiser's
+     * guides look through, at what it reflects or refracts
+     */
+    virtual bool specular( void ) const { return false; }
+
+protected:
+    explicit material( int kind ) : kind( kind ) {}
 };
 
-class lambertian : public material
+class lambertian final : public material
 {
 public:
-    lambertian( const color& albedo ) : albedo( albedo ) {}
+    static constexpr int kind_id = material_kinds::lambertian;
+
+    lambertian( const color& albedo ) : material( kind_id ), albedo( albedo ) {}
 
     bool scatter( const ray& r_in, const hit_record& rec, color& attentuation,
-                  ray& scattered ) const override
+                  ray& scattered, sampler& gen ) const override
     {
-        auto scatter_direction = rec.normal + random_unit_vector();
+        RTW_STAT( ++stats::local().scatters[kind_id] );
 
-        if ( scatter_direction.near_zero() ) {
-            scatter_direction = rec.normal;
-        }
+        auto scatter_direction = frame( rec.normal ).to_world( sample_cosine_hemisphere( gen ) );
 
-        scattered    = ray( rec.p, scatter_direction );
+        scattered    = rec.spawn_ray( scatter_direction );
         attentuation = albedo;
 
         return true;
     }
 
+    color surface_albedo( const hit_record& ) const override { return albedo; }
+
 private:
     color albedo;
 };
 
-class metal : public material
+class metal final : public material
 {
 public:
+    static constexpr int kind_id = material_kinds::metal;
+
     metal( const color& albedo, double fuzz )
-        : albedo( albedo ), fuzz( fuzz < 1 ? fuzz : 1 ) {}
+        : material( kind_id ), albedo( albedo ), fuzz( fuzz < 1 ? fuzz : 1 ) {}
 
     bool scatter( const ray& r_in, const hit_record& rec, color& attenuation,
-                  ray& scattered ) const override
+                  ray& scattered, sampler& gen ) const override
     {
+        RTW_STAT( ++stats::local().scatters[kind_id] );
+
         vec3 reflected = reflect( r_in.direction(), rec.normal );
-        reflected = unit_vector( reflected ) + ( fuzz * random_unit_vector() );
+        reflected = unit_vector( reflected ) + ( fuzz * sample_sphere_uniform( gen ) );
 
-        scattered   = ray( rec.p, reflected );
+        scattered   = rec.spawn_ray( reflected );
         attenuation = albedo;
 
         return ( dot( scattered.direction(), rec.normal ) > 0 );
     }
 
+    color surface_albedo( const hit_record& ) const override { return albedo; }
+
+    /* Only near-perfect mirrors: a blurry reflection is smooth enough to filter as it is */
+    bool specular( void ) const override { return fuzz < 0.1; }
+
 private:
     color  albedo;
     double fuzz;
 };
 
-class dielectric : public material
+class dielectric final : public material
 {
 public:
-    dielectric( double refraction_index ) : refraction_index( refraction_index ) {}
+    static constexpr int kind_id = material_kinds::dielectric;
+
+    dielectric( double refraction_index ) : material( kind_id ), refraction_index( refraction_index ) {}
 
     bool scatter( const ray& r_in, const hit_record& rec, color& attenuation,
-                  ray& scattered ) const override
+                  ray& scattered, sampler& gen ) const override
     {
+        RTW_STAT( ++stats::local().scatters[kind_id] );
+
         attenuation = color( 1.0, 1.0, 1.0 );
         double r_i = rec.front_face ? ( 1.0 / refraction_index ) : refraction_index;
 
@@ -85,17 +125,22 @@ public:
 
         bool cannot_refract = r_i * sin_theta  > 1.0;
         vec3 direction;
-        if ( cannot_refract || reflectance( cos_theta, r_i ) > random_double() ) {
+        if ( cannot_refract || reflectance( cos_theta, r_i ) > gen.next_1d() ) {
             direction = reflect( unit_direction, rec.normal );
         } else {
             direction = refract( unit_direction, rec.normal, r_i );
         }
 
-        scattered = ray( rec.p, direction );
+        scattered = rec.spawn_ray( direction );
 
         return true;
     }
 
+    /* Clear glass tints nothing */
+    color surface_albedo( const hit_record& ) const override { return color( 1, 1, 1 ); }
+
+    bool specular( void ) const override { return true; }
+
 private:
     double refraction_index;
 
@@ -108,4 +153,30 @@ private:
     }
 };
 
+/*
+ * Closed-world material dispatch.  «scatter» compares the material's tag
+ * against each of «Materials» and calls the match directly, so the compiler
+ * can inline it into the integrator; any other material falls back to the
+ * virtual call.  An integrator instantiated with «material_set<>» is fully
+ * virtual.
+ */
+template <typename... Materials>
+struct material_set
+{
+    static bool scatter( const material& mat, const ray& r_in, const hit_record& rec,
+                         color& attenuation, ray& scattered, sampler& gen )
+    {
+        bool result = false;
+        bool known  = ( ( mat.kind == Materials::kind_id
+                          && ( result = static_cast<const Materials&>( mat ).scatter( r_in, rec, attenuation,
+                                                                                      scattered, gen ),
+                               true ) )
+                        || ... );
+
+        return known ? result : mat.scatter( r_in, rec, attenuation, scattered, gen );
+    }
+};
+
+using standard_materials = material_set<lambertian, metal, dielectric>;
+
 #endif
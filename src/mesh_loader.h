@@ -0,0 +1,517 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "triangle_mesh.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * Streaming loaders for Wavefront OBJ and PLY meshes.  Files are read in
+ * fixed-size chunks, so memory beyond the mesh itself stays bounded however
+ * large the file; OBJ chunks, text that costs far more to parse than to
+ * read, are parsed on a thread pool.  Only positions and triangles are
+ * kept, polygons split into fans.
+ */
+
+/* What a load took, for throughput reports */
+struct mesh_load_info
+{
+    std::uint64_t bytes   = 0;
+    double        seconds = 0;
+
+    double megabytes_per_second( void ) const { return seconds > 0 ? bytes / seconds * 1e-6 : 0; }
+};
+
+/* Bytes read per chunk, and chunks parsed per pool thread before they are merged */
+const size_t mesh_chunk_size       = 4 << 20;
+const size_t mesh_chunks_in_flight = 2;
+
+namespace mesh_detail
+{
+
+inline const char* skip_blanks( const char* p, const char* end )
+{
+    while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\r' ) ) { ++p; }
+    return p;
+}
+
+inline const char* next_line( const char* p, const char* end )
+{
+    const char* newline = static_cast<const char*>( std::memchr( p, '\n', size_t( end - p ) ) );
+    return newline ? newline + 1 : end;
+}
+
+/* A face corner: 0-based index, or for negative OBJ indices an offset from the chunk's first vertex */
+struct obj_corner
+{
+    std::int64_t index;
+    bool         relative;
+};
+
+/* One chunk of an OBJ file, parsed on its own */
+struct obj_chunk
+{
+    std::string             text;
+    std::vector<float>      positions;
+    std::vector<obj_corner> corners;        /* Three per triangle */
+    std::string             error;
+
+    void parse( void )
+    {
+        const char* p   = text.data();
+        const char* end = p + text.size();
+
+        std::vector<obj_corner> polygon;
+        std::int64_t            local_vertices = 0;
+
+        while ( p < end ) {
+            const char* line_end = next_line( p, end );
+            p = skip_blanks( p, line_end );
+
+            if ( line_end - p > 1 && p[0] == 'v' && ( p[1] == ' ' || p[1] == '\t' ) ) {
+                p += 1;
+                for ( int a = 0; a < 3; ++a ) {
+                    float value;
+                    p = skip_blanks( p, line_end );
+                    auto result = std::from_chars( p, line_end, value );
+                    if ( result.ec != std::errc() ) {
+                        error = "malformed vertex";
+                        return;
+                    }
+                    positions.push_back( value );
+                    p = result.ptr;
+                }
+                ++local_vertices;
+            } else if ( line_end - p > 1 && p[0] == 'f' && ( p[1] == ' ' || p[1] == '\t' ) ) {
+                p += 1;
+                polygon.clear();
+                while ( true ) {
+                    p = skip_blanks( p, line_end );
+                    if ( p == line_end || *p == '\n' || *p == '#' ) { break; }
+
+                    std::int64_t value;
+                    auto result = std::from_chars( p, line_end, value );
+                    if ( result.ec != std::errc() || value == 0 ) {
+                        error = "malformed face";
+                        return;
+                    }
+                    polygon.push_back( value > 0 ? obj_corner{ value - 1, false }
+                                                 : obj_corner{ local_vertices + value, true } );
+
+                    /* Skip texture and normal indices */
+                    p = result.ptr;
+                    while ( p < line_end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' ) { ++p; }
+                }
+
+                if ( polygon.size() < 3 ) {
+                    error = "face with fewer than three vertices";
+                    return;
+                }
+                for ( size_t i = 1; i + 1 < polygon.size(); ++i ) {
+                    corners.push_back( polygon[0] );
+                    corners.push_back( polygon[i] );
+                    corners.push_back( polygon[i + 1] );
+                }
+            }
+
+            p = line_end;
+        }
+    }
+};
+
+/* Buffered sequential reads, for PLY bodies */
+class byte_reader
+{
+public:
+    explicit byte_reader( std::ifstream& in ) : in( in ) {}
+
+    /* «size» bytes, valid until the next call; nullptr at the end of the file */
+    const char* take( size_t size )
+    {
+        if ( end - position < size ) {
+            buffer.erase( buffer.begin(), buffer.begin() + std::ptrdiff_t( position ) );
+            end     -= position;
+            position = 0;
+
+            buffer.resize( std::max( mesh_chunk_size, size ) );
+            in.read( buffer.data() + end, std::streamsize( buffer.size() - end ) );
+            end += size_t( in.gcount() );
+            if ( end < size ) { return nullptr; }
+        }
+
+        const char* data = buffer.data() + position;
+        position += size;
+
+        return data;
+    }
+
+    /* The next line without its terminator; false at the end of the file */
+    bool line( std::string& text )
+    {
+        text.clear();
+        while ( true ) {
+            const char* c = take( 1 );
+            if ( c == nullptr ) { return ! text.empty(); }
+            if ( *c == '\n' ) { return true; }
+            if ( *c != '\r' ) { text.push_back( *c ); }
+        }
+    }
+
+private:
+    std::ifstream&    in;
+    std::vector<char> buffer;
+    size_t            position = 0, end = 0;
+};
+
+enum class ply_type { int8, uint8, int16, uint16, int32, uint32, float32, float64, none };
+
+inline ply_type parse_ply_type( const std::string& name )
+{
+    if ( name == "char" || name == "int8" )      { return ply_type::int8; }
+    if ( name == "uchar" || name == "uint8" )    { return ply_type::uint8; }
+    if ( name == "short" || name == "int16" )    { return ply_type::int16; }
+    if ( name == "ushort" || name == "uint16" )  { return ply_type::uint16; }
+    if ( name == "int" || name == "int32" )      { return ply_type::int32; }
+    if ( name == "uint" || name == "uint32" )    { return ply_type::uint32; }
+    if ( name == "float" || name == "float32" )  { return ply_type::float32; }
+    if ( name == "double" || name == "float64" ) { return ply_type::float64; }
+    return ply_type::none;
+}
+
+inline size_t ply_size( ply_type type )
+{
+    switch ( type ) {
+    case ply_type::int8:    case ply_type::uint8:   return 1;
+    case ply_type::int16:   case ply_type::uint16:  return 2;
+    case ply_type::int32:   case ply_type::uint32:  case ply_type::float32: return 4;
+    case ply_type::float64: return 8;
+    default:                return 0;
+    }
+}
+
+/* Binary value of «type» at «data», byte-swapped unless it is in the machine's order */
+inline double ply_value( const char* data, ply_type type, bool swap )
+{
+    char bytes[8];
+    size_t size = ply_size( type );
+    for ( size_t i = 0; i < size; ++i ) {
+        bytes[i] = data[swap ? size - 1 - i : i];
+    }
+
+    auto as = [&]( auto value ) {
+        std::memcpy( &value, bytes, sizeof( value ) );
+        return double( value );
+    };
+
+    switch ( type ) {
+    case ply_type::int8:    return as( std::int8_t() );
+    case ply_type::uint8:   return as( std::uint8_t() );
+    case ply_type::int16:   return as( std::int16_t() );
+    case ply_type::uint16:  return as( std::uint16_t() );
+    case ply_type::int32:   return as( std::int32_t() );
+    case ply_type::uint32:  return as( std::uint32_t() );
+    case ply_type::float32: return as( float() );
+    default:                return as( double() );
+    }
+}
+
+struct ply_property
+{
+    std::string name;
+    ply_type    type       = ply_type::none;     /* Of the value, or of a list's items */
+    ply_type    count_type = ply_type::none;     /* Of a list's length; none for plain values */
+};
+
+struct ply_element
+{
+    std::string               name;
+    std::uint64_t             count = 0;
+    std::vector<ply_property> properties;
+};
+
+} // namespace mesh_detail
+
+/*
+ * Append the mesh in the OBJ file «path» to «mesh».  Chunks are cut at line
+ * ends and parsed in parallel a batch at a time; negative (relative) vertex
+ * references are resolved once the vertices before the chunk are counted.
+ */
+inline bool load_obj( const std::string& path, mesh_buffers& mesh, mesh_load_info& info, unsigned threads = 0 )
+{
+    using namespace mesh_detail;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::ifstream in( path, std::ios::binary );
+    if ( ! in ) {
+        std::cerr << "Error reading mesh " << path << std::endl;
+        return false;
+    }
+
+    thread_pool            pool( threads );
+    std::vector<obj_chunk> batch( pool.size() * mesh_chunks_in_flight );
+    std::string            carry;
+    std::uint64_t          bytes        = 0;
+    size_t                 first_vertex = mesh.vertex_count();
+
+    while ( in ) {
+        size_t filled = 0;
+        for ( ; filled < batch.size() && in; ++filled ) {
+            auto& chunk = batch[filled];
+            chunk.text = std::move( carry );
+            carry.clear();
+
+            size_t kept = chunk.text.size();
+            chunk.text.resize( kept + mesh_chunk_size );
+            in.read( &chunk.text[kept], std::streamsize( mesh_chunk_size ) );
+            chunk.text.resize( kept + size_t( in.gcount() ) );
+            bytes += std::uint64_t( in.gcount() );
+
+            /* Whole lines only; the partial last line starts the next chunk */
+            size_t line_end = chunk.text.rfind( '\n' );
+            if ( in && line_end != std::string::npos ) {
+                carry.assign( chunk.text, line_end + 1, std::string::npos );
+                chunk.text.resize( line_end + 1 );
+            }
+        }
+
+        pool.parallel_for( filled, [&]( size_t i ) { batch[i].parse(); } );
+
+        for ( size_t i = 0; i < filled; ++i ) {
+            auto& chunk = batch[i];
+            if ( ! chunk.error.empty() ) {
+                std::cerr << "Mesh " << path << ": " << chunk.error << std::endl;
+                return false;
+            }
+
+            std::int64_t base = std::int64_t( mesh.vertex_count() );
+            mesh.positions.insert( mesh.positions.end(), chunk.positions.begin(), chunk.positions.end() );
+
+            for ( const auto& corner : chunk.corners ) {
+                std::int64_t index = corner.relative ? base + corner.index
+                                                     : std::int64_t( first_vertex ) + corner.index;
+                if ( index < 0 || index > std::int64_t( UINT32_MAX ) ) {
+                    std::cerr << "Mesh " << path << ": vertex reference out of range" << std::endl;
+                    return false;
+                }
+                mesh.indices.push_back( std::uint32_t( index ) );
+            }
+
+            chunk = obj_chunk();
+        }
+    }
+
+    /* Absolute references may point ahead, so they are only checked at the end */
+    for ( auto index : mesh.indices ) {
+        if ( index >= mesh.vertex_count() ) {
+            std::cerr << "Mesh " << path << ": vertex reference out of range" << std::endl;
+            return false;
+        }
+    }
+
+    info.bytes   = bytes;
+    info.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+    return true;
+}
+
+/*
+ * Append the mesh in the PLY file «path» to «mesh»: x, y and z of the
+ * "vertex" element and the "vertex_indices" list of the "face" element, in
+ * ASCII or binary of either byte order; other elements and properties are
+ * skipped.
+ */
+inline bool load_ply( const std::string& path, mesh_buffers& mesh, mesh_load_info& info )
+{
+    using namespace mesh_detail;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::ifstream in( path, std::ios::binary );
+    if ( ! in ) {
+        std::cerr << "Error reading mesh " << path << std::endl;
+        return false;
+    }
+
+    in.seekg( 0, std::ios::end );
+    std::uint64_t bytes = std::uint64_t( in.tellg() );
+    in.seekg( 0, std::ios::beg );
+
+    byte_reader reader( in );
+    std::string line;
+    auto fail = [&]( const char* problem ) {
+        std::cerr << "Mesh " << path << ": " << problem << std::endl;
+        return false;
+    };
+
+    if ( ! reader.line( line ) || line != "ply" ) { return fail( "not a PLY file" ); }
+
+    /* Header */
+    std::vector<ply_element> elements;
+    bool ascii = false, swap = false;
+    while ( true ) {
+        if ( ! reader.line( line ) ) { return fail( "header not terminated" ); }
+
+        std::vector<std::string> words;
+        for ( size_t p = 0; p < line.size(); ) {
+            size_t q = line.find( ' ', p );
+            if ( q == std::string::npos ) { q = line.size(); }
+            if ( q > p ) { words.push_back( line.substr( p, q - p ) ); }
+            p = q + 1;
+        }
+        if ( words.empty() ) { continue; }
+
+        if ( words[0] == "end_header" ) {
+            break;
+        } else if ( words[0] == "format" && words.size() >= 2 ) {
+            std::uint16_t probe = 1;
+            bool          little_endian_machine = *reinterpret_cast<const std::uint8_t*>( &probe ) == 1;
+
+            ascii = words[1] == "ascii";
+            if ( words[1] == "binary_little_endian" ) {
+                swap = ! little_endian_machine;
+            } else if ( words[1] == "binary_big_endian" ) {
+                swap = little_endian_machine;
+            } else if ( ! ascii ) {
+                return fail( "unknown format" );
+            }
+        } else if ( words[0] == "element" && words.size() >= 3 ) {
+            ply_element element;
+            element.name  = words[1];
+            element.count = std::strtoull( words[2].c_str(), nullptr, 10 );
+            elements.push_back( element );
+        } else if ( words[0] == "property" && ! elements.empty() ) {
+            ply_property property;
+            if ( words.size() >= 5 && words[1] == "list" ) {
+                property.count_type = parse_ply_type( words[2] );
+                property.type       = parse_ply_type( words[3] );
+                property.name       = words[4];
+                if ( property.count_type == ply_type::none ) { return fail( "unknown property type" ); }
+            } else if ( words.size() >= 3 ) {
+                property.type = parse_ply_type( words[1] );
+                property.name = words[2];
+            }
+            if ( property.type == ply_type::none ) { return fail( "unknown property type" ); }
+            elements.back().properties.push_back( property );
+        }
+    }
+
+    /* Body, one element after the other */
+    std::vector<std::uint32_t> polygon;
+    size_t                     first_vertex = mesh.vertex_count();
+
+    for ( const auto& element : elements ) {
+        bool is_vertex = element.name == "vertex";
+        bool is_face   = element.name == "face";
+
+        /* Axis of each property of a vertex, or -1 */
+        std::vector<int> coordinate( element.properties.size() );
+        for ( size_t p = 0; p < element.properties.size(); ++p ) {
+            const auto& name = element.properties[p].name;
+            coordinate[p] = name == "x" ? 0 : name == "y" ? 1 : name == "z" ? 2 : -1;
+        }
+        if ( is_vertex ) {
+            mesh.positions.reserve( mesh.positions.size() + ( 3 * element.count ) );
+        }
+
+        for ( std::uint64_t item = 0; item < element.count; ++item ) {
+            const char* cursor = nullptr;
+            const char* end    = nullptr;
+            if ( ascii ) {
+                if ( ! reader.line( line ) ) { return fail( "truncated" ); }
+                cursor = line.data();
+                end    = cursor + line.size();
+            }
+
+            /* The next value of «type», from the line or the binary stream */
+            auto read = [&]( ply_type type, double& value ) {
+                if ( ascii ) {
+                    cursor = skip_blanks( cursor, end );
+                    auto result = std::from_chars( cursor, end, value );
+                    cursor = result.ptr;
+                    return result.ec == std::errc();
+                }
+                const char* data = reader.take( ply_size( type ) );
+                if ( data == nullptr ) { return false; }
+                value = ply_value( data, type, swap );
+                return true;
+            };
+
+            float position[3] = { 0, 0, 0 };
+            for ( size_t p = 0; p < element.properties.size(); ++p ) {
+                const auto& property = element.properties[p];
+                double      value;
+
+                if ( property.count_type == ply_type::none ) {
+                    if ( ! read( property.type, value ) ) { return fail( "truncated" ); }
+                    if ( is_vertex && coordinate[p] >= 0 ) {
+                        position[coordinate[p]] = float( value );
+                    }
+                    continue;
+                }
+
+                double length;
+                if ( ! read( property.count_type, length ) ) { return fail( "truncated" ); }
+                if ( ! ( length >= 0 && length <= double( UINT32_MAX ) && length == std::trunc( length ) ) ) {
+                    return fail( "malformed list length" );
+                }
+
+                bool indices = is_face && ( property.name == "vertex_indices" || property.name == "vertex_index" );
+                polygon.clear();
+                for ( std::uint64_t i = 0; i < std::uint64_t( length ); ++i ) {
+                    if ( ! read( property.type, value ) ) { return fail( "truncated" ); }
+                    if ( indices ) {
+                        if ( ! ( value >= 0 && value <= double( UINT32_MAX - first_vertex ) ) ) { return fail( "vertex reference out of range" ); }
+                        polygon.push_back( std::uint32_t( first_vertex + std::uint32_t( value ) ) );
+                    }
+                }
+
+                for ( size_t i = 1; indices && i + 1 < polygon.size(); ++i ) {
+                    mesh.indices.push_back( polygon[0] );
+                    mesh.indices.push_back( polygon[i] );
+                    mesh.indices.push_back( polygon[i + 1] );
+                }
+            }
+
+            if ( is_vertex ) {
+                mesh.positions.insert( mesh.positions.end(), position, position + 3 );
+            }
+        }
+    }
+
+    for ( auto index : mesh.indices ) {
+        if ( index >= mesh.vertex_count() ) { return fail( "vertex reference out of range" ); }
+    }
+
+    info.bytes   = bytes;
+    info.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+    return true;
+}
+
+/* Load the OBJ or PLY file «path» by its extension */
+inline bool load_mesh( const std::string& path, mesh_buffers& mesh, mesh_load_info& info, unsigned threads = 0 )
+{
+    auto has_extension = [&]( const char* extension ) {
+        size_t length = std::strlen( extension );
+        return path.size() >= length && path.compare( path.size() - length, length, extension ) == 0;
+    };
+
+    if ( has_extension( ".obj" ) || has_extension( ".OBJ" ) ) { return load_obj( path, mesh, info, threads ); }
+    if ( has_extension( ".ply" ) || has_extension( ".PLY" ) ) { return load_ply( path, mesh, info ); }
+
+    std::cerr << "Mesh " << path << ": not an .obj or .ply file" << std::endl;
+    return false;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "ray.h"
+
+/*
+ * A bundle of up to «size» rays (a 4x4 block of primary rays) traced through
+ * the scene together.  Lanes [0, «count») are in use.
+ */
+struct ray_packet
+{
+    static constexpr int width = 4;
+    static constexpr int size  = width * width;
+
+    ray rays[size];
+    int count = 0;
+};
+
+#endif
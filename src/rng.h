@@ -0,0 +1,59 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+/*
+ * PCG32 (XSH-RR) generator: 64 bits of state, 32-bit output.
+ *
+ * Each generator is explicit, cheap to construct and owns all of its state,
+ * so the camera can give every (pixel, sample) pair its own stream and get
+ * the same image regardless of scheduling.
+ */
+class rng
+{
+public:
+    rng() : rng( 0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL ) {}
+
+    rng( std::uint64_t seed, std::uint64_t stream )
+    {
+        state = 0;
+        inc   = ( mix( stream ) << 1 ) | 1;
+        next_uint();
+        state += mix( seed );
+        next_uint();
+    }
+
+    std::uint32_t next_uint( void )
+    {
+        std::uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+
+        auto xorshifted = std::uint32_t( ( ( old >> 18 ) ^ old ) >> 27 );
+        auto rot        = std::uint32_t( old >> 59 );
+
+        return ( xorshifted >> rot ) | ( xorshifted << ( ( 32 - rot ) & 31 ) );
+    }
+
+    /* Uniform in [0, 1) with 32 bits of resolution */
+    double next_double( void )
+    {
+        return next_uint() * 0x1.0p-32;
+    }
+
+private:
+    std::uint64_t state;
+    std::uint64_t inc;
+
+    /* SplitMix64 finalizer, so that neighbouring seeds decorrelate */
+    static std::uint64_t mix( std::uint64_t x )
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x  = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+        x  = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebULL;
+
+        return x ^ ( x >> 31 );
+    }
+};
+
+#endif
@@ -0,0 +1,996 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "environment.h"
+#include "film.h"
+#include "instance.h"
+#include "linear_bvh.h"
+#include "material.h"
+#include "mesh_loader.h"
+#include "sampling.h"
+#include "scene.h"
+#include "scenes.h"
+#include "sphere.h"
+#include "sphere_soa.h"
+
+/*
+ * Fixed benchmark scenes, rendered without writing images.  Results go to
+ * stdout as JSON; progress goes to stderr.
+ */
+
+/*
+ * Rays traced, counted per thread and summed when the threads exit, so
+ * counting costs no shared cache line on the tracing path.
+ */
+class ray_counter
+{
+public:
+    static void add( std::uint64_t count ) { local().count += count; }
+
+    static void reset( void )
+    {
+        retired = 0;
+        local().count = 0;
+    }
+
+    /* Only complete once the render's worker threads have exited */
+    static std::uint64_t total( void ) { return retired + local().count; }
+
+private:
+    struct counter
+    {
+        std::uint64_t count = 0;
+        ~counter() { retired += count; }
+    };
+
+    static counter& local( void )
+    {
+        static thread_local counter c;
+        return c;
+    }
+
+    static std::atomic<std::uint64_t> retired;
+};
+
+std::atomic<std::uint64_t> ray_counter::retired( 0 );
+
+/* «World» with every traced ray counted */
+template <typename World>
+class counted_world
+{
+public:
+    explicit counted_world( const World& world ) : world( world ) {}
+
+    bool hit( const ray& r, interval ray_t, hit_record& rec ) const
+    {
+        ray_counter::add( 1 );
+        return world.hit( r, ray_t, rec );
+    }
+
+    void hit_packet( const ray_packet& packet, interval ray_t, hit_record* recs, bool* hits ) const
+    {
+        ray_counter::add( std::uint64_t( packet.count ) );
+        world.hit_packet( packet, ray_t, recs, hits );
+    }
+
+private:
+    World world;
+};
+
+struct bench_case
+{
+    const char* name;
+    int         half_extent;        /* Small spheres on a (2 half_extent)² grid */
+    sphere_mix  mix;
+    bool        mirror_box;         /* Enclose everything in a mirror, so paths never escape */
+    int         max_depth;
+    int         samples_per_pixel;
+    bool        roulette;           /* Russian roulette from the camera's default depth */
+};
+
+struct bench_result
+{
+    size_t        objects;
+    size_t        scene_bytes;
+    int           threads;
+    std::uint64_t rays;
+    double        build_s, compile_s, render_s;
+};
+
+using seconds_clock = std::chrono::steady_clock;
+
+static double since( seconds_clock::time_point start )
+{
+    return std::chrono::duration<double>( seconds_clock::now() - start ).count();
+}
+
+/* The cover shot, rendered without writing an image */
+static camera bench_camera( int image_width, int threads )
+{
+    camera cam;
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = image_width;
+    cam.max_depth         = 50;
+    cam.v_fov             = 20;
+    cam.look_from         = point3( 13, 2, 3 );
+    cam.look_at           = point3( 0, 0, 0 );
+    cam.v_up              = vec3( 0, 1, 0 );
+    cam.defocus_angle     = 0.6;
+    cam.focus_distance    = 10.0;
+    cam.thread_count      = threads;
+    cam.image_path        = "";
+
+    return cam;
+}
+
+static bench_result run_case( const bench_case& bc, int image_width, int threads )
+{
+    bench_result result;
+    result.threads = threads;
+
+    auto start = seconds_clock::now();
+
+    scene world;
+    rng   gen;
+    random_spheres( world, gen, bc.half_extent, bc.mix );
+    if ( bc.mirror_box ) {
+        world.add_sphere( point3( 0, 0, 0 ), 100, world.add_material<metal>( color( 0.95, 0.95, 0.95 ), 0.0 ) );
+    }
+    result.objects = world.sphere_count();
+    result.build_s = since( start );
+
+    start = seconds_clock::now();
+    auto compiled = world.compile();
+    result.compile_s   = since( start );
+    result.scene_bytes = compiled->footprint();
+
+    camera cam = bench_camera( image_width, threads );
+    cam.samples_per_pixel = bc.samples_per_pixel;
+    cam.max_depth         = bc.max_depth;
+    cam.packet_primary    = true;
+    cam.roulette          = bc.roulette;
+
+    /* Keep the camera's progress line out of the way */
+    std::clog.setstate( std::ios::badbit );
+
+    ray_counter::reset();
+    start = seconds_clock::now();
+    cam.render<standard_materials>( counted_world<typed_bvh<sphere>>( compiled->typed_world() ) );
+    result.render_s = since( start );
+    result.rays     = ray_counter::total();
+
+    std::clog.clear();
+
+    return result;
+}
+
+static void write_result( const char* name, const bench_result& r, int image_width, int spp,
+                          bool last )
+{
+    int    image_height = std::max( 1, int( image_width / ( 16.0 / 9.0 ) ) );
+    double samples      = double( image_width ) * image_height * spp;
+
+    std::cout << "    { \"name\": \"" << name << "\""
+              << ", \"objects\": " << r.objects
+              << ", \"scene_bytes\": " << r.scene_bytes
+              << ", \"threads\": " << r.threads
+              << ", \"samples_per_pixel\": " << spp
+              << ", \"rays\": " << r.rays
+              << ", \"mrays_per_s\": " << r.rays / r.render_s * 1e-6
+              << ", \"samples_per_s\": " << samples / r.render_s
+              << ", \"phases\": { \"build_s\": " << r.build_s
+              << ", \"compile_s\": " << r.compile_s
+              << ", \"render_s\": " << r.render_s << " } }"
+              << ( last ? "\n" : ",\n" );
+}
+
+/*
+ * Sampling microbenchmark: the rejection samplers the renderer used to draw
+ * directions and lens positions with, against the warps in «sampling.h».
+ */
+
+static vec3 rejection_in_unit_sphere( rng& gen )
+{
+    while ( true ) {
+        auto p = vec3::random( gen, -1, 1 );
+        if ( p.length_squared() < 1 ) {
+            return p;
+        }
+    }
+}
+
+static vec3 rejection_in_unit_disk( rng& gen )
+{
+    while ( true ) {
+        auto p = vec3( real( random_double( gen, -1, 1 ) ), real( random_double( gen, -1, 1 ) ), 0 );
+        if ( p.length_squared() < 1 ) {
+            return p;
+        }
+    }
+}
+
+/* Nanoseconds per call of «sample», which maps a normal and a generator to a vector */
+template <typename Sample>
+static double time_sampler( const std::vector<vec3>& normals, Sample sample, vec3& sink )
+{
+    const int count = 1 << 22;
+
+    rng  gen;
+    vec3 sum;
+
+    auto start = seconds_clock::now();
+    for ( int i = 0; i < count; ++i ) {
+        sum += sample( normals[i & ( normals.size() - 1 )], gen );
+    }
+    double seconds = since( start );
+
+    /* Keep the loop from being optimized away */
+    sink += sum;
+
+    return seconds / count * 1e9;
+}
+
+static void write_sampling( void )
+{
+    std::vector<vec3> normals( 1024 );
+    rng gen( 1, 1 );
+    for ( auto& n : normals ) {
+        n = sample_sphere_uniform( gen );
+    }
+
+    vec3 sink;
+
+    struct timing
+    {
+        const char* name;
+        double      rejection_ns, analytic_ns;
+    };
+
+    const timing timings[] = {
+        { "unit_sphere",
+          time_sampler( normals, []( const vec3&, rng& g ) { return unit_vector( rejection_in_unit_sphere( g ) ); }, sink ),
+          time_sampler( normals, []( const vec3&, rng& g ) { return sample_sphere_uniform( g ); }, sink ) },
+        { "unit_disk",
+          time_sampler( normals, []( const vec3&, rng& g ) { return rejection_in_unit_disk( g ); }, sink ),
+          time_sampler( normals, []( const vec3&, rng& g ) { return sample_disk_concentric( g ); }, sink ) },
+        { "cosine_direction",
+          time_sampler( normals, []( const vec3& n, rng& g ) {
+              return n + unit_vector( rejection_in_unit_sphere( g ) );
+          }, sink ),
+          time_sampler( normals, []( const vec3& n, rng& g ) {
+              return frame( n ).to_world( sample_cosine_hemisphere( g ) );
+          }, sink ) },
+    };
+
+    std::cout << "  \"sampling\": [\n";
+
+    size_t count = sizeof( timings ) / sizeof( timings[0] );
+    for ( size_t i = 0; i < count; ++i ) {
+        std::cout << "    { \"name\": \"" << timings[i].name << "\""
+                  << ", \"rejection_ns\": " << timings[i].rejection_ns
+                  << ", \"analytic_ns\": " << timings[i].analytic_ns
+                  << ", \"speedup\": " << timings[i].rejection_ns / timings[i].analytic_ns << " }"
+                  << ( i + 1 == count ? "\n" : ",\n" );
+    }
+
+    std::cout << "  ],\n";
+    std::cerr << "Sampling checksum " << sink.length() << "\n";
+}
+
+/*
+ * Leaf kernels: the cover and a denser field of spheres rendered through
+ * the hierarchy with one «sphere::hit» per sphere in a leaf, and with each
+ * leaf tested as a block by «sphere_soa_bvh».  The images must be equal.
+ */
+static void write_leaf_kernels( int image_width, int spp, int threads )
+{
+    const int half_extents[] = { 11, 35 };
+
+    std::clog.setstate( std::ios::badbit );
+    std::cout << "  \"leaf_kernels\": { \"isa\": \"" << sphere_soa::isa() << "\", \"scenes\": [\n";
+
+    size_t count = sizeof( half_extents ) / sizeof( half_extents[0] );
+    for ( size_t i = 0; i < count; ++i ) {
+        scene world;
+        rng   gen;
+        random_spheres( world, gen, half_extents[i] );
+        auto compiled = world.compile();
+
+        auto start = seconds_clock::now();
+        sphere_soa_bvh blocks( compiled->hierarchy() );
+        double build = since( start );
+
+        auto render = [&]( const auto& view, double& seconds ) {
+            film   image;
+            camera cam = bench_camera( image_width, threads );
+            cam.samples_per_pixel = spp;
+            cam.packet_primary    = true;
+            cam.output_film       = &image;
+
+            auto start = seconds_clock::now();
+            cam.render<standard_materials>( view );
+            seconds = since( start );
+
+            return image;
+        };
+
+        double scalar_s, soa_s;
+        film   scalar = render( compiled->typed_world(), scalar_s );
+        film   soa    = render( blocks, soa_s );
+
+        bool equal = scalar.counts == soa.counts
+                     && std::memcmp( scalar.sums.data(), soa.sums.data(), scalar.sums.size() * sizeof( color_sum ) ) == 0;
+
+        std::cout << "    { \"spheres\": " << compiled->sphere_count()
+                  << ", \"scalar_s\": " << scalar_s
+                  << ", \"soa_s\": " << soa_s
+                  << ", \"speedup\": " << scalar_s / soa_s
+                  << ", \"soa_build_s\": " << build
+                  << ", \"soa_bytes\": " << blocks.footprint()
+                  << ", \"identical\": " << ( equal ? "true" : "false" ) << " }"
+                  << ( i + 1 == count ? "\n" : ",\n" );
+    }
+
+    std::cout << "  ] },\n";
+    std::clog.clear();
+}
+
+/*
+ * Dispatch: many small «parallel_for» calls in a row on one pool, as
+ * progressive passes and the denoiser's passes make, timing each and
+ * checking that every call ran each of its indices exactly once.
+ */
+static void write_dispatch( int threads )
+{
+    const int    calls = 200000;
+    const size_t count = 3;
+
+    thread_pool pool( static_cast<unsigned>( std::max( 2, threads ) ) );
+
+    std::atomic<unsigned> ran[count];
+    std::uint64_t         wrong = 0;
+
+    auto start = seconds_clock::now();
+    for ( int call = 0; call < calls; ++call ) {
+        for ( auto& r : ran ) { r.store( 0, std::memory_order_relaxed ); }
+
+        pool.parallel_for( count, [&ran]( size_t i ) { ran[i].fetch_add( 1, std::memory_order_relaxed ); } );
+
+        for ( auto& r : ran ) {
+            if ( r.load( std::memory_order_relaxed ) != 1 ) { ++wrong; }
+        }
+    }
+    double seconds = since( start );
+
+    std::cout << "  \"dispatch\": { \"threads\": " << pool.size()
+              << ", \"calls\": " << calls
+              << ", \"tasks_per_call\": " << count
+              << ", \"us_per_call\": " << seconds / calls * 1e6
+              << ", \"wrong_tasks\": " << wrong << " },\n";
+}
+
+/* RMSE of the displayed, gamma-corrected and clamped, pixel values */
+static double display_rmse( const film& image, const film& reference )
+{
+    double squares = 0;
+
+    for ( size_t pixel = 0; pixel < image.sums.size(); ++pixel ) {
+        color a = image.average( pixel ), b = reference.average( pixel );
+        for ( int c = 0; c < 3; ++c ) {
+            double d = linear_to_gamma( std::fmin( a[c], 1.0 ) ) - linear_to_gamma( std::fmin( b[c], 1.0 ) );
+            squares += d * d;
+        }
+    }
+
+    return std::sqrt( squares / ( 3.0 * image.sums.size() ) );
+}
+
+/*
+ * Convergence of each sample pattern: image error against a reference for
+ * 1, 2, 4, ... «max_spp» samples per pixel.  The reference takes 16 times
+ * as many Sobol samples with a seed of its own, so it shares no numbers
+ * with the renders it is compared to.
+ */
+static void write_convergence( int image_width, int max_spp, int threads )
+{
+    scene world;
+    rng   gen;
+    random_spheres( world, gen );
+    auto compiled = world.compile();
+    auto typed    = compiled->typed_world();
+
+    std::clog.setstate( std::ios::badbit );
+
+    auto render = [&]( sample_pattern pattern, int spp, std::uint32_t seed ) {
+        film   image;
+        camera cam = bench_camera( image_width, threads );
+        cam.samples_per_pixel = spp;
+        cam.sampling          = pattern;
+        cam.seed              = seed;
+        cam.output_film       = &image;
+        cam.render<standard_materials>( typed );
+        return image;
+    };
+
+    int  reference_spp = 16 * max_spp;
+    film reference     = render( sample_pattern::sobol, reference_spp, 1 );
+
+    struct pattern_name
+    {
+        sample_pattern pattern;
+        const char*    name;
+    };
+    const pattern_name patterns[] = {
+        { sample_pattern::independent, "independent" },
+        { sample_pattern::sobol,       "sobol" },
+        { sample_pattern::blue_noise,  "blue_noise" },
+    };
+
+    std::cout << "  \"convergence\": {\n"
+              << "    \"image_width\": " << image_width
+              << ", \"reference_spp\": " << reference_spp << ",\n"
+              << "    \"patterns\": [\n";
+
+    size_t count = sizeof( patterns ) / sizeof( patterns[0] );
+    for ( size_t i = 0; i < count; ++i ) {
+        std::cout << "      { \"name\": \"" << patterns[i].name << "\", \"rmse\": [";
+
+        for ( int spp = 1; spp <= max_spp; spp *= 2 ) {
+            std::cout << ( spp > 1 ? ", " : " " ) << "{ \"spp\": " << spp
+                      << ", \"rmse\": " << display_rmse( render( patterns[i].pattern, spp, 0 ), reference ) << " }";
+        }
+
+        std::cout << " ] }" << ( i + 1 == count ? "\n" : ",\n" );
+    }
+
+    std::cout << "    ]\n"
+              << "  },\n";
+
+    std::clog.clear();
+}
+
+/*
+ * Denoising: image error against a reference, as in «write_convergence», of
+ * renders with 1, 2, 4, ... «max_spp» Sobol samples per pixel before and
+ * after «denoise_film», and the time the filter takes.
+ */
+static void write_denoising( int image_width, int max_spp, int threads )
+{
+    scene world;
+    rng   gen;
+    random_spheres( world, gen );
+    auto compiled = world.compile();
+    auto typed    = compiled->typed_world();
+
+    std::clog.setstate( std::ios::badbit );
+
+    auto render = [&]( int spp, std::uint32_t seed, guide_buffers* guides ) {
+        film   image;
+        camera cam = bench_camera( image_width, threads );
+        cam.samples_per_pixel = spp;
+        cam.sampling          = sample_pattern::sobol;
+        cam.seed              = seed;
+        cam.output_film       = &image;
+        cam.output_guides     = guides;
+        cam.render<standard_materials>( typed );
+        return image;
+    };
+
+    int  reference_spp = 16 * max_spp;
+    film reference     = render( reference_spp, 1, nullptr );
+
+    thread_pool pool( static_cast<unsigned>( threads ) );
+
+    std::cout << "  \"denoising\": {\n"
+              << "    \"image_width\": " << image_width
+              << ", \"reference_spp\": " << reference_spp << ",\n"
+              << "    \"rmse\": [";
+
+    for ( int spp = 1; spp <= max_spp; spp *= 2 ) {
+        guide_buffers guides;
+        film          noisy = render( spp, 0, &guides );
+
+        auto start    = seconds_clock::now();
+        film denoised = denoise_film( noisy, guides, pool );
+        double filter = since( start );
+
+        std::cout << ( spp > 1 ? ",\n      " : "\n      " ) << "{ \"spp\": " << spp
+                  << ", \"noisy\": " << display_rmse( noisy, reference )
+                  << ", \"denoised\": " << display_rmse( denoised, reference )
+                  << ", \"denoise_s\": " << filter << " }";
+    }
+
+    std::cout << "\n    ]\n"
+              << "  },\n";
+
+    std::clog.clear();
+}
+
+/*
+ * Instancing: the cover stretched to «copies»² tiles of small spheres,
+ * stored once per sphere and as instances of one tile.
+ */
+static void write_instancing( int image_width, int spp, int threads )
+{
+    const int grids[] = { 8, 46 };
+
+    std::clog.setstate( std::ios::badbit );
+    std::cout << "  \"instancing\": [\n";
+
+    size_t count = sizeof( grids ) / sizeof( grids[0] );
+    for ( size_t i = 0; i < count; ++i ) {
+        int copies = grids[i];
+
+        camera cam = bench_camera( image_width, threads );
+        cam.samples_per_pixel = spp;
+        cam.packet_primary    = true;
+
+        auto start = seconds_clock::now();
+        scene world;
+        flat_spheres( world, copies );
+        auto   flat      = world.compile();
+        double flat_make = since( start );
+
+        ray_counter::reset();
+        start = seconds_clock::now();
+        cam.render<standard_materials>( counted_world<typed_bvh<sphere>>( flat->typed_world() ) );
+        double        flat_render = since( start );
+        std::uint64_t flat_rays   = ray_counter::total();
+
+        start = seconds_clock::now();
+        instanced_scene instanced;
+        instanced_spheres( instanced, copies );
+        double instanced_make = since( start );
+
+        ray_counter::reset();
+        start = seconds_clock::now();
+        cam.render<standard_materials>( counted_world<typed_instances<sphere>>( instanced.typed_world<sphere>() ) );
+        double        instanced_render = since( start );
+        std::uint64_t instanced_rays   = ray_counter::total();
+
+        std::cout << "    { \"copies\": " << copies * copies
+                  << ", \"spheres\": " << instanced.sphere_count()
+                  << ", \"flat\": { \"scene_bytes\": " << flat->footprint()
+                  << ", \"build_s\": " << flat_make
+                  << ", \"render_s\": " << flat_render
+                  << ", \"mrays_per_s\": " << flat_rays / flat_render * 1e-6 << " }"
+                  << ", \"instanced\": { \"scene_bytes\": " << instanced.footprint()
+                  << ", \"build_s\": " << instanced_make
+                  << ", \"render_s\": " << instanced_render
+                  << ", \"mrays_per_s\": " << instanced_rays / instanced_render * 1e-6 << " } }"
+                  << ( i + 1 == count ? "\n" : ",\n" );
+    }
+
+    std::cout << "  ],\n";
+    std::clog.clear();
+}
+
+/* A lumpy sphere of 4 «rings»² triangles, each vertex shared by its neighbours */
+static mesh_buffers lumpy_sphere( int rings )
+{
+    mesh_buffers mesh;
+    int          segments = 2 * rings;
+
+    for ( int i = 0; i <= rings; ++i ) {
+        double theta = pi * i / rings;
+        for ( int j = 0; j < segments; ++j ) {
+            double phi    = 2 * pi * j / segments;
+            double radius = 1 + ( 0.08 * std::sin( 7 * theta ) * std::sin( 5 * phi ) );
+            mesh.positions.push_back( float( radius * std::sin( theta ) * std::cos( phi ) ) );
+            mesh.positions.push_back( float( radius * std::cos( theta ) ) );
+            mesh.positions.push_back( float( radius * std::sin( theta ) * std::sin( phi ) ) );
+        }
+    }
+
+    for ( int i = 0; i < rings; ++i ) {
+        for ( int j = 0; j < segments; ++j ) {
+            std::uint32_t a = std::uint32_t( ( i * segments ) + j );
+            std::uint32_t b = std::uint32_t( ( i * segments ) + ( ( j + 1 ) % segments ) );
+            std::uint32_t c = a + std::uint32_t( segments ), d = b + std::uint32_t( segments );
+            mesh.indices.insert( mesh.indices.end(), { a, c, b, b, c, d } );
+        }
+    }
+
+    return mesh;
+}
+
+/* The unit cube [0, 1]³, two triangles per face, all facing out */
+static mesh_buffers unit_cube( void )
+{
+    mesh_buffers mesh;
+    mesh.positions = { 0, 0, 0,  1, 0, 0,  0, 1, 0,  1, 1, 0,  0, 0, 1,  1, 0, 1,  0, 1, 1,  1, 1, 1 };
+    mesh.indices   = { 0, 2, 3,  0, 3, 1,  4, 5, 7,  4, 7, 6,  0, 1, 5,  0, 5, 4,
+                       2, 6, 7,  2, 7, 3,  0, 4, 6,  0, 6, 2,  1, 3, 7,  1, 7, 5 };
+
+    return mesh;
+}
+
+/* The square [-1, 1]² on the plane y = 0, like the ground of an OBJ scene */
+static mesh_buffers ground_quad( void )
+{
+    mesh_buffers mesh;
+    mesh.positions = { -1, 0, -1,  1, 0, -1,  -1, 0, 1,  1, 0, 1 };
+    mesh.indices   = { 0, 2, 3,  0, 3, 1 };
+
+    return mesh;
+}
+
+/*
+ * Rays along each of «axes» from both sides, aimed at a 5×5 grid of points
+ * spanning the faces of the box [«lo», «hi»], corners and edges included,
+ * from 2 units away; the number that miss or stop anywhere but the face.
+ */
+static int face_misses( const hittable& object, const point3& lo, const point3& hi, const bool axes[3] )
+{
+    int misses = 0;
+
+    for ( int a = 0; a < 3; ++a ) {
+        if ( ! axes[a] ) { continue; }
+
+        int b = ( a + 1 ) % 3, c = ( a + 2 ) % 3;
+        for ( int side = 0; side < 2; ++side ) {
+            for ( int i = 0; i <= 4; ++i ) {
+                for ( int j = 0; j <= 4; ++j ) {
+                    double orig[3], dir[3] = { 0, 0, 0 };
+                    orig[a] = side ? hi[a] + 2 : lo[a] - 2;
+                    orig[b] = lo[b] + ( ( hi[b] - lo[b] ) * i / 4 );
+                    orig[c] = lo[c] + ( ( hi[c] - lo[c] ) * j / 4 );
+                    dir[a]  = side ? -1 : 1;
+
+                    ray        r( point3( orig[0], orig[1], orig[2] ), vec3( dir[0], dir[1], dir[2] ) );
+                    hit_record rec;
+                    if ( ! object.hit( r, interval( 0, infinity ), rec ) || std::fabs( rec.t - 2 ) > 1e-4 ) {
+                        ++misses;
+                    }
+                }
+            }
+        }
+    }
+
+    return misses;
+}
+
+static void write_obj( const mesh_buffers& mesh, const std::string& path )
+{
+    std::ofstream out( path, std::ios::binary );
+    char          line[96];
+
+    for ( size_t v = 0; v < mesh.vertex_count(); ++v ) {
+        const float* p = &mesh.positions[3 * v];
+        out.write( line, std::snprintf( line, sizeof( line ), "v %.7g %.7g %.7g\n", p[0], p[1], p[2] ) );
+    }
+    for ( size_t t = 0; t < mesh.triangle_count(); ++t ) {
+        const std::uint32_t* i = &mesh.indices[3 * t];
+        out.write( line, std::snprintf( line, sizeof( line ), "f %u %u %u\n", i[0] + 1, i[1] + 1, i[2] + 1 ) );
+    }
+}
+
+/* Binary PLY in the machine's byte order, which is little-endian wherever this runs */
+static void write_ply( const mesh_buffers& mesh, const std::string& path )
+{
+    std::ofstream out( path, std::ios::binary );
+    out << "ply\nformat binary_little_endian 1.0\n"
+        << "element vertex " << mesh.vertex_count() << "\n"
+        << "property float x\nproperty float y\nproperty float z\n"
+        << "element face " << mesh.triangle_count() << "\n"
+        << "property list uchar uint vertex_indices\nend_header\n";
+
+    out.write( reinterpret_cast<const char*>( mesh.positions.data() ),
+               std::streamsize( mesh.positions.size() * sizeof( float ) ) );
+    for ( size_t t = 0; t < mesh.triangle_count(); ++t ) {
+        const std::uint8_t corners = 3;
+        out.write( reinterpret_cast<const char*>( &corners ), 1 );
+        out.write( reinterpret_cast<const char*>( &mesh.indices[3 * t] ), 3 * sizeof( std::uint32_t ) );
+    }
+}
+
+/*
+ * Synthetic equirectangular sky: a dim gradient from horizon to zenith and
+ * a sun a few pixels across, some thousand times brighter, that lights the
+ * ground about as much as the rest of the sky.
+ */
+static std::vector<float> sun_sky( int width, int height )
+{
+    std::vector<float> rgb( size_t( width ) * height * 3 );
+    vec3 sun = unit_vector( vec3( 2, 1.5, 1 ) );
+
+    for ( int y = 0; y < height; ++y ) {
+        for ( int x = 0; x < width; ++x ) {
+            double phi   = 2 * pi * ( ( ( x + 0.5 ) / width ) - 0.5 );
+            double theta = pi * ( y + 0.5 ) / height;
+            vec3   d( std::sin( theta ) * std::sin( phi ), std::cos( theta ), -std::sin( theta ) * std::cos( phi ) );
+
+            double a = 0.5 * ( d.y() + 1 );
+            color  c = ( ( 1 - a ) * color( 0.6, 0.6, 0.6 ) ) + ( a * color( 0.3, 0.4, 0.6 ) );
+            if ( dot( d, sun ) > std::cos( degrees_to_radians( 2.5 ) ) ) { c = color( 1000, 900, 800 ); }
+
+            float* p = &rgb[( ( size_t( y ) * width ) + x ) * 3];
+            p[0] = float( c.x() );
+            p[1] = float( c.y() );
+            p[2] = float( c.z() );
+        }
+    }
+
+    return rgb;
+}
+
+/*
+ * Environment lighting: image error against a reference, as in
+ * «write_convergence», of the cover under a small bright sun for 1, 2, 4,
+ * ... «max_spp» Sobol samples per pixel, with the map found by bounces
+ * alone and with it also sampled directly at diffuse bounces.  The map goes
+ * through a Radiance HDR file and «environment_map::load».
+ */
+static void write_environment( int image_width, int max_spp, int threads )
+{
+    const int map_width = 512, map_height = 256;
+
+    auto path = ( std::filesystem::temp_directory_path() / "rt_bench_sky.hdr" ).string();
+    {
+        std::vector<float> rgb = sun_sky( map_width, map_height );
+        stbi_write_hdr( path.c_str(), map_width, map_height, 3, rgb.data() );
+    }
+
+    environment_map sky;
+    auto start  = seconds_clock::now();
+    bool loaded = sky.load( path );
+    double load = since( start );
+    std::remove( path.c_str() );
+    if ( ! loaded ) { return; }
+
+    scene world;
+    rng   gen;
+    random_spheres( world, gen );
+    auto compiled = world.compile();
+    auto typed    = compiled->typed_world();
+
+    std::clog.setstate( std::ios::badbit );
+
+    auto render = [&]( int spp, std::uint32_t seed, bool sample_environment, double& seconds ) {
+        film   image;
+        camera cam = bench_camera( image_width, threads );
+        cam.samples_per_pixel  = spp;
+        cam.sampling           = sample_pattern::sobol;
+        cam.seed               = seed;
+        cam.output_film        = &image;
+        cam.environment        = &sky;
+        cam.sample_environment = sample_environment;
+
+        auto start = seconds_clock::now();
+        cam.render<standard_materials>( typed );
+        seconds = since( start );
+
+        return image;
+    };
+
+    double seconds;
+    int    reference_spp = 16 * max_spp;
+    film   reference     = render( reference_spp, 1, true, seconds );
+
+    std::cout << "  \"environment\": {\n"
+              << "    \"image_width\": " << image_width
+              << ", \"map\": \"" << map_width << "x" << map_height << "\""
+              << ", \"load_s\": " << load
+              << ", \"map_bytes\": " << sky.footprint()
+              << ", \"reference_spp\": " << reference_spp << ",\n"
+              << "    \"rmse\": [";
+
+    for ( int spp = 1; spp <= max_spp; spp *= 2 ) {
+        double bsdf_s, mis_s;
+        film   bsdf = render( spp, 0, false, bsdf_s );
+        film   mis  = render( spp, 0, true, mis_s );
+
+        std::cout << ( spp > 1 ? ",\n      " : "\n      " ) << "{ \"spp\": " << spp
+                  << ", \"bsdf\": " << display_rmse( bsdf, reference )
+                  << ", \"bsdf_s\": " << bsdf_s
+                  << ", \"mis\": " << display_rmse( mis, reference )
+                  << ", \"mis_s\": " << mis_s << " }";
+    }
+
+    std::cout << "\n    ]\n"
+              << "  },\n";
+
+    std::clog.clear();
+}
+
+/*
+ * Meshes: loading OBJ and binary PLY files of a generated mesh, building its
+ * quantized hierarchy, and rendering it on the ground.
+ */
+static void write_meshes( int image_width, int spp, int threads )
+{
+    const int rings[] = { 250, 700 };
+
+    std::clog.setstate( std::ios::badbit );
+    std::cout << "  \"meshes\": [\n";
+
+    auto directory = std::filesystem::temp_directory_path();
+    auto obj_path  = ( directory / "rt_bench_mesh.obj" ).string();
+    auto ply_path  = ( directory / "rt_bench_mesh.ply" ).string();
+
+    size_t count = sizeof( rings ) / sizeof( rings[0] );
+    for ( size_t i = 0; i < count; ++i ) {
+        {
+            mesh_buffers generated = lumpy_sphere( rings[i] );
+            write_obj( generated, obj_path );
+            write_ply( generated, ply_path );
+        }
+
+        mesh_buffers   from_obj, from_ply;
+        mesh_load_info obj_info, ply_info;
+        load_obj( obj_path, from_obj, obj_info, unsigned( threads ) );
+        load_ply( ply_path, from_ply, ply_info );
+        std::remove( obj_path.c_str() );
+        std::remove( ply_path.c_str() );
+        from_obj = mesh_buffers();
+
+        lambertian mesh_material( color( 0.6, 0.55, 0.5 ) );
+        lambertian ground_material( color( 0.5, 0.5, 0.5 ) );
+
+        auto start = seconds_clock::now();
+        auto mesh  = make_shared<triangle_mesh>( std::move( from_ply ), &mesh_material );
+        double build = since( start );
+
+        camera        cam = bench_camera( image_width, threads );
+        hittable_list world;
+        mesh_stage( world, mesh, &ground_material, cam );
+        cam.samples_per_pixel = spp;
+        cam.packet_primary    = true;
+
+        ray_counter::reset();
+        start = seconds_clock::now();
+        cam.render<standard_materials>( counted_world<hittable_list>( world ) );
+        double        render = since( start );
+        std::uint64_t rays   = ray_counter::total();
+
+        std::cout << "    { \"triangles\": " << mesh->triangle_count()
+                  << ", \"vertices\": " << mesh->vertex_count()
+                  << ", \"obj\": { \"bytes\": " << obj_info.bytes
+                  << ", \"load_s\": " << obj_info.seconds
+                  << ", \"mb_per_s\": " << obj_info.megabytes_per_second() << " }"
+                  << ", \"ply\": { \"bytes\": " << ply_info.bytes
+                  << ", \"load_s\": " << ply_info.seconds
+                  << ", \"mb_per_s\": " << ply_info.megabytes_per_second() << " }"
+                  << ", \"build_s\": " << build
+                  << ", \"mesh_bytes\": " << mesh->footprint()
+                  << ", \"bytes_per_triangle\": " << double( mesh->footprint() ) / double( mesh->triangle_count() )
+                  << ", \"node_bytes\": " << mesh->node_count() * sizeof( quantized_bvh_node )
+                  << ", \"unquantized_node_bytes\": " << mesh->node_count() * sizeof( linear_bvh_node )
+                  << ", \"render_s\": " << render
+                  << ", \"mrays_per_s\": " << rays / render * 1e-6 << " }"
+                  << ( i + 1 == count ? "\n" : ",\n" );
+    }
+
+    /* Boxes flat on the mesh's grid, which its quantized nodes must still enclose */
+    lambertian    face_material( color( 0.5, 0.5, 0.5 ) );
+    triangle_mesh cube( unit_cube(), &face_material );
+    triangle_mesh quad( ground_quad(), &face_material );
+    const bool    every_axis[3] = { true, true, true };
+    const bool    y_axis[3]     = { false, true, false };
+
+    std::cout << "  ],\n"
+              << "  \"mesh_faces\": { \"cube_misses\": " << face_misses( cube, point3( 0, 0, 0 ), point3( 1, 1, 1 ), every_axis )
+              << ", \"plane_misses\": " << face_misses( quad, point3( -1, 0, -1 ), point3( 1, 0, 1 ), y_axis ) << " },\n";
+    std::clog.clear();
+}
+
+static void usage( const char* program )
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --width N    image width (default 320)\n"
+              << "  --spp N      samples per pixel (default 16)\n"
+              << "  --threads N  most threads to scale to (default: hardware concurrency)\n";
+}
+
+int main( int argc, char* argv[] )
+{
+    int image_width = 320;
+    int spp         = 16;
+    int max_threads = int( std::max( 1u, std::thread::hardware_concurrency() ) );
+
+    for ( int arg = 1; arg < argc; ++arg ) {
+        bool has_value = arg + 1 < argc;
+
+        if ( std::strcmp( argv[arg], "--width" ) == 0 && has_value ) {
+            image_width = std::max( 16, std::atoi( argv[++arg] ) );
+        } else if ( std::strcmp( argv[arg], "--spp" ) == 0 && has_value ) {
+            spp = std::max( 1, std::atoi( argv[++arg] ) );
+        } else if ( std::strcmp( argv[arg], "--threads" ) == 0 && has_value ) {
+            max_threads = std::max( 1, std::atoi( argv[++arg] ) );
+        } else {
+            usage( argv[0] );
+            return 1;
+        }
+    }
+
+    const bench_case cases[] = {
+        { "spheres_500",          11,  sphere_mix::mixed,      false, 50,  spp,                    false },
+        { "spheres_500_roulette", 11,  sphere_mix::mixed,      false, 50,  spp,                    true },
+        { "spheres_5k",           35,  sphere_mix::mixed,      false, 50,  spp,                    false },
+        { "spheres_50k",          112, sphere_mix::mixed,      false, 50,  spp,                    false },
+        { "dielectric",           11,  sphere_mix::dielectric, false, 50,  spp,                    false },
+        { "metal",                11,  sphere_mix::metal,      false, 50,  spp,                    false },
+        { "deep_bounce",          11,  sphere_mix::metal,      true,  200, std::max( 1, spp / 4 ), false },
+        { "deep_bounce_roulette", 11,  sphere_mix::metal,      true,  200, std::max( 1, spp / 4 ), true },
+    };
+
+    std::cout.precision( 6 );
+    std::cout << "{\n"
+              << "  \"real\": \"" << ( sizeof( real ) == sizeof( float ) ? "float" : "double" ) << "\",\n"
+              << "  \"image_width\": " << image_width << ",\n";
+
+    std::cerr << "Timing samplers\n";
+    write_sampling();
+
+    std::cerr << "Dispatching small parallel loops\n";
+    write_dispatch( max_threads );
+
+    std::cerr << "Comparing leaf kernels\n";
+    write_leaf_kernels( image_width, std::max( 1, spp / 4 ), max_threads );
+
+    std::cerr << "Measuring convergence\n";
+    write_convergence( std::max( 16, image_width / 2 ), spp, max_threads );
+
+    std::cerr << "Measuring denoising\n";
+    write_denoising( std::max( 16, image_width / 2 ), spp, max_threads );
+
+    std::cerr << "Measuring environment lighting\n";
+    write_environment( std::max( 16, image_width / 2 ), spp, max_threads );
+
+    std::cerr << "Comparing instanced and flat scenes\n";
+    write_instancing( image_width, std::max( 1, spp / 4 ), max_threads );
+
+    std::cerr << "Loading and rendering meshes\n";
+    write_meshes( image_width, std::max( 1, spp / 4 ), max_threads );
+
+    std::cout << "  \"cases\": [\n";
+
+    size_t case_count = sizeof( cases ) / sizeof( cases[0] );
+    for ( size_t i = 0; i < case_count; ++i ) {
+        std::cerr << "Running " << cases[i].name << "\n";
+        auto result = run_case( cases[i], image_width, max_threads );
+        write_result( cases[i].name, result, image_width, cases[i].samples_per_pixel, i + 1 == case_count );
+    }
+
+    std::cout << "  ],\n"
+              << "  \"scaling\": [\n";
+
+    std::vector<int> thread_counts;
+    for ( int threads = 1; threads < max_threads; threads *= 2 ) {
+        thread_counts.push_back( threads );
+    }
+    thread_counts.push_back( max_threads );
+
+    double base_rate = 0;
+    for ( size_t i = 0; i < thread_counts.size(); ++i ) {
+        std::cerr << "Scaling with " << thread_counts[i] << " threads\n";
+        auto   result = run_case( cases[0], image_width, thread_counts[i] );
+        double rate   = result.rays / result.render_s;
+        if ( i == 0 ) { base_rate = rate; }
+
+        std::cout << "    { \"threads\": " << thread_counts[i]
+                  << ", \"mrays_per_s\": " << rate * 1e-6
+                  << ", \"speedup\": " << rate / base_rate << " }"
+                  << ( i + 1 == thread_counts.size() ? "\n" : ",\n" );
+    }
+
+    std::cout << "  ]\n"
+              << "}\n";
+
+    return 0;
+}
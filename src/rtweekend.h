@@ -12,6 +12,8 @@ using std::shared_ptr;
 /* Common headers */
 
 #include "constants.h"
+#include "rng.h"
+#include "stats.h"
 
 /* Utility functions */
 
@@ -20,14 +22,14 @@ inline double degrees_to_radians( double degrees )
     return degrees * pi / 180.0;
 }
 
-inline double random_double( void )
+inline double random_double( rng& gen )
 {
-    return std::rand() / ( RAND_MAX + 1.0 );
+    return gen.next_double();
 }
 
-inline double random_double( double min, double max )
+inline double random_double( rng& gen, double min, double max )
 {
-    return min + ( ( max - min ) * random_double() );
+    return min + ( ( max - min ) * random_double( gen ) );
 }
 
 #endif
@@ -0,0 +1,343 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rtweekend.h"
+#include "sampling.h"
+#include "vec3.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/* How a path's random numbers are chosen; see «sampler» */
+enum class sample_pattern
+{
+    independent,    /* Every number drawn independently */
+    sobol,          /* Owen-scrambled Sobol points, scrambled per pixel */
+    blue_noise      /* One scrambled Sobol sequence, shifted per pixel by a blue-noise mask */
+};
+
+/* The pattern called «name» on the command line; false if there is none */
+inline bool parse_sample_pattern( const char* name, sample_pattern& pattern )
+{
+    if ( std::strcmp( name, "independent" ) == 0 ) {
+        pattern = sample_pattern::independent;
+    } else if ( std::strcmp( name, "sobol" ) == 0 ) {
+        pattern = sample_pattern::sobol;
+    } else if ( std::strcmp( name, "blue-noise" ) == 0 ) {
+        pattern = sample_pattern::blue_noise;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/* 32-bit integer hash (Wellons' lowbias32) */
+inline std::uint32_t hash_uint( std::uint32_t x )
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+
+    return x;
+}
+
+inline std::uint32_t reverse_bits( std::uint32_t x )
+{
+    x = ( ( x & 0x55555555U ) << 1 ) | ( ( x >> 1 ) & 0x55555555U );
+    x = ( ( x & 0x33333333U ) << 2 ) | ( ( x >> 2 ) & 0x33333333U );
+    x = ( ( x & 0x0f0f0f0fU ) << 4 ) | ( ( x >> 4 ) & 0x0f0f0f0fU );
+    x = ( ( x & 0x00ff00ffU ) << 8 ) | ( ( x >> 8 ) & 0x00ff00ffU );
+
+    return ( x << 16 ) | ( x >> 16 );
+}
+
+/*
+ * Random permutation of 32-bit fixed-point values in [0, 1) that only ever
+ * swaps whole halves of the dyadic intervals, which is what Owen scrambling
+ * does: scrambled Sobol points keep their stratification.  Burley,
+ * "Practical Hash-based Owen Scrambling" (2020).
+ */
+inline std::uint32_t owen_scramble( std::uint32_t x, std::uint32_t seed )
+{
+    x = reverse_bits( x );
+
+    /* Laine and Karras' hash: each bit only depends on the bits below it */
+    x += seed;
+    x ^= x * 0x6c50b47cU;
+    x ^= x * 0xb82f1e52U;
+    x ^= x * 0xc7afe638U;
+    x ^= x * 0x8d22f6e6U;
+
+    return reverse_bits( x );
+}
+
+/*
+ * Second dimension of the Sobol sequence, from the primitive polynomial
+ * x + 1, for each byte of the index: one XOR of four lookups instead of a
+ * loop over the index bits, which scrambled indices set all of.
+ */
+struct sobol_tables
+{
+    std::uint32_t bytes[4][256];
+
+    constexpr sobol_tables() : bytes{}
+    {
+        std::uint32_t direction[32] = {};
+        direction[0] = 1U << 31;
+        for ( int bit = 1; bit < 32; ++bit ) {
+            direction[bit] = direction[bit - 1] ^ ( direction[bit - 1] >> 1 );
+        }
+
+        for ( int byte = 0; byte < 4; ++byte ) {
+            for ( int value = 0; value < 256; ++value ) {
+                std::uint32_t y = 0;
+                for ( int bit = 0; bit < 8; ++bit ) {
+                    y ^= ( value & ( 1 << bit ) ) ? direction[( 8 * byte ) + bit] : 0;
+                }
+                bytes[byte][value] = y;
+            }
+        }
+    }
+};
+
+inline constexpr sobol_tables sobol_y_tables;
+
+/*
+ * The first two dimensions of the Sobol sequence as 32-bit fixed point: the
+ * van der Corput sequence and the one above.  Together their first 2^k
+ * points put one point in each of the 2^k rectangles of any shape
+ * 2^-a × 2^-(k-a).
+ */
+inline void sobol_2d( std::uint32_t index, std::uint32_t& x, std::uint32_t& y )
+{
+    const auto& t = sobol_y_tables.bytes;
+
+    x = reverse_bits( index );
+    y = t[0][index & 0xff] ^ t[1][( index >> 8 ) & 0xff] ^ t[2][( index >> 16 ) & 0xff] ^ t[3][index >> 24];
+}
+
+/*
+ * Tileable 64×64 blue-noise mask, made once by Ulichney's void-and-cluster
+ * method: starting from a relaxed random pattern, cells are ranked by
+ * repeatedly taking out the tightest cluster and filling in the largest
+ * void, measured by a toroidal Gaussian energy.  Neighbouring cells get
+ * values far apart, so the error of per-pixel shifts by it has little low
+ * frequency content.
+ */
+class blue_noise_mask
+{
+public:
+    static constexpr int size = 64;
+
+    static const blue_noise_mask& get( void )
+    {
+        static const blue_noise_mask mask;
+        return mask;
+    }
+
+    /* Value in (0, 1) of the cell («x», «y»), wrapping around */
+    double value( int x, int y ) const
+    {
+        return ( ranks[( ( y & ( size - 1 ) ) * size ) + ( x & ( size - 1 ) )] + 0.5 ) / cells;
+    }
+
+private:
+    static constexpr int cells = size * size;
+
+    std::vector<std::uint16_t> ranks;
+
+    blue_noise_mask() : ranks( cells )
+    {
+        /* Gaussian of σ = 1.5 over toroidal offsets */
+        std::vector<double> kernel( cells );
+        for ( int dy = 0; dy < size; ++dy ) {
+            for ( int dx = 0; dx < size; ++dx ) {
+                int    wx = std::min( dx, size - dx ), wy = std::min( dy, size - dy );
+                double d2 = double( wx * wx + wy * wy );
+                kernel[( dy * size ) + dx] = std::exp( -d2 / ( 2 * 1.5 * 1.5 ) );
+            }
+        }
+
+        std::vector<char>   pattern( cells, 0 );
+        std::vector<double> energy( cells, 0.0 );
+
+        auto toggle = [&]( int cell, bool on ) {
+            pattern[cell] = on;
+
+            int    cx = cell % size, cy = cell / size;
+            double sign = on ? 1.0 : -1.0;
+            for ( int y = 0; y < size; ++y ) {
+                for ( int x = 0; x < size; ++x ) {
+                    int dx = ( x - cx ) & ( size - 1 ), dy = ( y - cy ) & ( size - 1 );
+                    energy[( y * size ) + x] += sign * kernel[( dy * size ) + dx];
+                }
+            }
+        };
+
+        /* Highest energy among set cells, or lowest among empty ones */
+        auto tightest_cluster = [&]( void ) {
+            int best = -1;
+            for ( int c = 0; c < cells; ++c ) {
+                if ( pattern[c] && ( best < 0 || energy[c] > energy[best] ) ) { best = c; }
+            }
+            return best;
+        };
+        auto largest_void = [&]( void ) {
+            int best = -1;
+            for ( int c = 0; c < cells; ++c ) {
+                if ( ! pattern[c] && ( best < 0 || energy[c] < energy[best] ) ) { best = c; }
+            }
+            return best;
+        };
+
+        /* Initial pattern: a tenth of the cells at random, then relaxed */
+        rng gen( 0x5eed, 0xb1 );
+        int ones = 0;
+        while ( ones < cells / 10 ) {
+            int cell = int( gen.next_uint() % cells );
+            if ( ! pattern[cell] ) {
+                toggle( cell, true );
+                ++ones;
+            }
+        }
+
+        while ( true ) {
+            int cluster = tightest_cluster();
+            toggle( cluster, false );
+
+            int hole = largest_void();
+            toggle( hole, true );
+            if ( hole == cluster ) { break; }
+        }
+
+        std::vector<char>   initial_pattern = pattern;
+        std::vector<double> initial_energy  = energy;
+
+        /* The initial cells rank below the rest, tightest cluster last */
+        for ( int rank = ones - 1; rank >= 0; --rank ) {
+            int cluster = tightest_cluster();
+            ranks[cluster] = std::uint16_t( rank );
+            toggle( cluster, false );
+        }
+
+        /*
+         * Then fill in voids.  Past half full, the tightest cluster of empty
+         * cells is the largest void of set cells, so one rule does for both.
+         */
+        pattern = initial_pattern;
+        energy  = initial_energy;
+        for ( int rank = ones; rank < cells; ++rank ) {
+            int hole = largest_void();
+            ranks[hole] = std::uint16_t( rank );
+            toggle( hole, true );
+        }
+    }
+};
+
+/*
+ * Source of the random numbers of one path: the sample of pixel («x», «y»)
+ * numbered «sample».  Each request for one or two numbers is a dimension of
+ * the path's sample point.  With low-discrepancy patterns, a pixel's samples
+ * spread evenly over each dimension's square, where independent numbers
+ * clump; the error then falls faster than 1/√N with the number of samples.
+ *
+ * Sobol points are padded rather than taken to higher dimensions: every
+ * dimension is the two-dimensional sequence, shuffled and scrambled by its
+ * own seed, as higher Sobol dimensions need far more samples to pay off.
+ * Renders with a different «seed» are independent of each other.
+ */
+class sampler
+{
+public:
+    sampler() : sampler( sample_pattern::independent, 0, 0, 0, 0 ) {}
+
+    sampler( sample_pattern pattern, int x, int y, std::uint64_t pixel, int sample,
+             std::uint32_t seed = 0 )
+      : gen( pixel, ( std::uint64_t( seed ) << 32 ) | std::uint32_t( sample ) ),
+        pattern( pattern ),
+        index( std::uint32_t( sample ) ),
+        x( x ), y( y )
+    {
+        /* Blue noise shares one sequence between all pixels */
+        scramble = hash_uint( seed ^ hash_uint( pattern == sample_pattern::blue_noise ? 0 : std::uint32_t( pixel ) ) );
+    }
+
+    double next_1d( void )
+    {
+        if ( pattern == sample_pattern::independent ) {
+            return gen.next_double();
+        }
+
+        double u1, u2;
+        next_2d( u1, u2 );
+
+        return u1;
+    }
+
+    void next_2d( double& u1, double& u2 )
+    {
+        if ( pattern == sample_pattern::independent ) {
+            u1 = gen.next_double();
+            u2 = gen.next_double();
+            return;
+        }
+
+        std::uint32_t seed = hash_uint( scramble + dimension );
+        std::uint32_t sx, sy;
+        sobol_2d( owen_scramble( index, seed ), sx, sy );
+
+        u1 = owen_scramble( sx, hash_uint( seed ^ 0x1 ) ) * 0x1.0p-32;
+        u2 = owen_scramble( sy, hash_uint( seed ^ 0x2 ) ) * 0x1.0p-32;
+
+        if ( pattern == sample_pattern::blue_noise ) {
+            /* Toroidal shift by the mask, read at an offset of its own for each number */
+            const auto& mask = blue_noise_mask::get();
+            u1 = wrap( u1 + mask.value( x + int( seed & 63 ), y + int( ( seed >> 6 ) & 63 ) ) );
+            u2 = wrap( u2 + mask.value( x + int( ( seed >> 12 ) & 63 ), y + int( ( seed >> 18 ) & 63 ) ) );
+        }
+
+        ++dimension;
+    }
+
+private:
+    rng            gen;
+    sample_pattern pattern;
+    std::uint32_t  index;
+    std::uint32_t  scramble  = 0;
+    std::uint32_t  dimension = 0;
+    int            x, y;
+
+    static double wrap( double u ) { return u >= 1 ? u - 1 : u; }
+};
+
+inline vec3 sample_disk_concentric( sampler& gen )
+{
+    double u1, u2;
+    gen.next_2d( u1, u2 );
+
+    return sample_disk_concentric( real( u1 ), real( u2 ) );
+}
+
+inline vec3 sample_sphere_uniform( sampler& gen )
+{
+    double u1, u2;
+    gen.next_2d( u1, u2 );
+
+    return sample_sphere_uniform( real( u1 ), real( u2 ) );
+}
+
+inline vec3 sample_cosine_hemisphere( sampler& gen )
+{
+    double u1, u2;
+    gen.next_2d( u1, u2 );
+
+    return sample_cosine_hemisphere( real( u1 ), real( u2 ) );
+}
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include "rtweekend.h"
+#include "vec3.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Warps from the unit square to the domains the renderer samples.  Each one
+ * maps a point (u1, u2) of [0, 1)² through a fixed sequence of operations:
+ * exactly two random numbers, no rejection loop and no data-dependent branch,
+ * and nearby inputs land nearby, so stratified or low-discrepancy points stay
+ * well distributed.  The «rng» overloads draw (u1, u2) from «gen».
+ */
+
+/*
+ * «if_true» when «mask» is 1 and «if_false» when it is 0, as arithmetic: a
+ * conditional expression over floating-point values usually compiles to a
+ * branch, which mispredicts half the time on random samples.
+ */
+inline real blend( real mask, real if_true, real if_false )
+{
+    return if_false + ( mask * ( if_true - if_false ) );
+}
+
+/*
+ * sin and cos of «theta» in [-π/4, π/4] from their Taylor series to the
+ * 12th order, within 1e-11 there: far below what a sampled direction can
+ * show, and much cheaper than the library functions, which must reduce any
+ * argument.  The two halves of each series are summed independently to
+ * shorten the chain of dependent operations.
+ */
+inline void sin_cos_quarter( real theta, real& sin_theta, real& cos_theta )
+{
+    real t2 = theta * theta;
+    real t4 = t2 * t2;
+    real t8 = t4 * t4;
+
+    real sin_low  = 1 + ( t2 * real( -1.0 / 6 ) ) + ( t4 * ( real( 1.0 / 120 ) + ( t2 * real( -1.0 / 5040 ) ) ) );
+    real sin_high = real( 1.0 / 362880 ) + ( t2 * real( -1.0 / 39916800 ) );
+    sin_theta     = theta * ( sin_low + ( t8 * sin_high ) );
+
+    real cos_low  = 1 + ( t2 * real( -1.0 / 2 ) ) + ( t4 * ( real( 1.0 / 24 ) + ( t2 * real( -1.0 / 720 ) ) ) );
+    real cos_high = real( 1.0 / 40320 ) + ( t2 * real( -1.0 / 3628800 ) ) + ( t4 * real( 1.0 / 479001600 ) );
+    cos_theta     = cos_low + ( t8 * cos_high );
+}
+
+/*
+ * sin and cos of the angle «turns» · 2π, for «turns» in [0, 1): the nearest
+ * quarter turn is taken out and the rest, within ±π/4, goes through
+ * «sin_cos_quarter»; the quarter turn swaps and negates the results.
+ */
+inline void sin_cos_turns( real turns, real& sin_phi, real& cos_phi )
+{
+    real x       = ( 4 * turns ) + real( 0.5 );
+    int  quarter = int( x );
+
+    real s, c;
+    sin_cos_quarter( ( x - real( quarter ) - real( 0.5 ) ) * real( pi / 2 ), s, c );
+
+    real swap = real( quarter & 1 );
+    cos_phi   = real( 1 - ( ( quarter + 1 ) & 2 ) ) * blend( swap, s, c );
+    sin_phi   = real( 1 - ( quarter & 2 ) ) * blend( swap, c, s );
+}
+
+/* Uniform on the unit disk in the xy plane, by Shirley and Chiu's concentric map */
+inline vec3 sample_disk_concentric( real u1, real u2 )
+{
+    real a = ( 2 * u1 ) - 1;
+    real b = ( 2 * u2 ) - 1;
+
+    /*
+     * Squares around the origin go to circles.  The larger coordinate is the
+     * radius; the angle is within π/4 of the x axis if it is «a» and of the y
+     * axis if it is «b», where sin and cos trade places.
+     */
+    real wedge_x = real( std::fabs( a ) > std::fabs( b ) );
+    real r       = blend( wedge_x, a, b );
+    real other   = blend( wedge_x, b, a );
+
+    /* At the centre itself the ratio would be 0/0 */
+    real ratio = other / ( r + real( r == 0 ) );
+
+    real s, c;
+    sin_cos_quarter( real( pi / 4 ) * ratio, s, c );
+
+    return vec3( r * blend( wedge_x, c, s ), r * blend( wedge_x, s, c ), 0 );
+}
+
+/* Uniform on the unit sphere: z is uniform in [-1, 1] by Archimedes' hat-box theorem */
+inline vec3 sample_sphere_uniform( real u1, real u2 )
+{
+    real z = 1 - ( 2 * u1 );
+    real r = std::sqrt( std::max( real( 0 ), 1 - ( z * z ) ) );
+
+    real s, c;
+    sin_cos_turns( u2, s, c );
+
+    return vec3( r * c, r * s, z );
+}
+
+/* Unit vectors about +z with density cos θ / π, by lifting the concentric disk (Malley's method) */
+inline vec3 sample_cosine_hemisphere( real u1, real u2 )
+{
+    vec3 d = sample_disk_concentric( u1, u2 );
+    real z = std::sqrt( std::max( real( 0 ), 1 - ( d.x() * d.x() ) - ( d.y() * d.y() ) ) );
+
+    return vec3( d.x(), d.y(), z );
+}
+
+inline vec3 sample_disk_concentric( rng& gen )
+{
+    real u1 = real( random_double( gen ) );
+    return sample_disk_concentric( u1, real( random_double( gen ) ) );
+}
+
+inline vec3 sample_sphere_uniform( rng& gen )
+{
+    real u1 = real( random_double( gen ) );
+    return sample_sphere_uniform( u1, real( random_double( gen ) ) );
+}
+
+inline vec3 sample_cosine_hemisphere( rng& gen )
+{
+    real u1 = real( random_double( gen ) );
+    return sample_cosine_hemisphere( u1, real( random_double( gen ) ) );
+}
+
+/*
+ * Orthonormal basis whose third axis is the unit vector «n», built without
+ * a branch on the direction of «n» (Duff et al., "Building an Orthonormal
+ * Basis, Revisited", 2017).
+ */
+class frame
+{
+public:
+    explicit frame( const vec3& n ) : n( n )
+    {
+        real sign = std::copysign( real( 1 ), n.z() );
+        real a    = -1 / ( sign + n.z() );
+        real b    = n.x() * n.y() * a;
+
+        s = vec3( 1 + ( sign * n.x() * n.x() * a ), sign * b, -sign * n.x() );
+        t = vec3( b, sign + ( n.y() * n.y() * a ), -n.y() );
+    }
+
+    /* «v» given in this frame's coordinates, in world coordinates */
+    vec3 to_world( const vec3& v ) const
+    {
+        return ( v.x() * s ) + ( v.y() * t ) + ( v.z() * n );
+    }
+
+private:
+    vec3 s, t, n;
+};
+
+/*
+ * Discrete distribution over the indices of a list of non-negative weights,
+ * sampled in constant time from one number (Vose's alias method).  Each
+ * entry keeps its own index with probability «prob» and otherwise gives way
+ * to «alias»; an empty or all-zero list cannot be sampled.
+ */
+class alias_table
+{
+public:
+    alias_table() = default;
+
+    explicit alias_table( const std::vector<double>& weights ) : entries( weights.size() )
+    {
+        double total = 0;
+        for ( double w : weights ) { total += w; }
+
+        sum = total;
+        if ( ! ( total > 0 ) ) {
+            entries.clear();
+            return;
+        }
+
+        /* Scaled so the mean is 1: entries below it are topped up by one above */
+        size_t                     n = weights.size();
+        std::vector<double>        scaled( n );
+        std::vector<std::uint32_t> small, large;
+        for ( size_t i = 0; i < n; ++i ) {
+            scaled[i] = weights[i] * double( n ) / total;
+            ( scaled[i] < 1 ? small : large ).push_back( std::uint32_t( i ) );
+        }
+
+        while ( ! small.empty() && ! large.empty() ) {
+            std::uint32_t lo = small.back();
+            std::uint32_t hi = large.back();
+            small.pop_back();
+
+            entries[lo] = { float( scaled[lo] ), hi };
+
+            scaled[hi] -= 1 - scaled[lo];
+            if ( scaled[hi] < 1 ) {
+                large.pop_back();
+                small.push_back( hi );
+            }
+        }
+
+        /* Whatever is left is 1 up to rounding */
+        for ( std::uint32_t i : small ) { entries[i] = { 1, i }; }
+        for ( std::uint32_t i : large ) { entries[i] = { 1, i }; }
+    }
+
+    bool   empty( void ) const { return entries.empty(); }
+    size_t size( void ) const  { return entries.size(); }
+
+    /* Sum of the weights the table was built from */
+    double total( void ) const { return sum; }
+
+    /*
+     * Index drawn from «u» in [0, 1).  Its fraction past the chosen entry
+     * picks between the entry and its alias, and is passed back in «remapped»
+     * as a fresh uniform number for the caller to reuse.
+     */
+    std::uint32_t sample( double u, double& remapped ) const
+    {
+        double       scaled = u * double( entries.size() );
+        size_t       i      = std::min( size_t( scaled ), entries.size() - 1 );
+        double       f      = scaled - double( i );
+        const entry& e      = entries[i];
+
+        if ( f < e.prob ) {
+            remapped = f / e.prob;
+            return std::uint32_t( i );
+        }
+
+        remapped = std::min( ( f - e.prob ) / ( 1 - e.prob ), 1 - 1e-9 );
+        return e.alias;
+    }
+
+private:
+    struct entry
+    {
+        float         prob;
+        std::uint32_t alias;
+    };
+
+    std::vector<entry> entries;
+    double             sum = 0;
+};
+
+#endif
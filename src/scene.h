@@ -0,0 +1,165 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "rtweekend.h"
+#include "arena.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+#include "material.h"
+#include "sphere.h"
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using material_id = std::uint32_t;
+
+/*
+ * A compiled scene: materials, primitives and the hierarchy over them laid
+ * out in a single arena.  Nothing in it changes after «scene::compile», so
+ * any number of threads can trace against it, and tracing never allocates.
+ */
+class compiled_scene
+{
+public:
+    const hittable& world( void ) const { return *root; }
+
+    /* The same world for closed-world integrators: every primitive is a sphere */
+    typed_bvh<sphere> typed_world( void ) const { return typed_bvh<sphere>( *root ); }
+
+    /* The hierarchy itself, e.g. for instances to refer to */
+    const linear_bvh& hierarchy( void ) const { return *root; }
+
+    size_t sphere_count( void ) const { return primitive_count; }
+
+    /* Bytes of the arena in use */
+    size_t footprint( void ) const { return storage.used(); }
+
+    void report( std::ostream& out ) const
+    {
+        out << "Scene: " << footprint() << " bytes in one arena ("
+            << material_bytes << " materials, "
+            << primitive_bytes << " primitives, "
+            << bvh_bytes << " hierarchy of " << node_count << " nodes)\n";
+    }
+
+private:
+    friend class scene;
+
+    explicit compiled_scene( size_t capacity ) : storage( capacity ) {}
+
+    arena             storage;
+    const linear_bvh* root = nullptr;
+
+    size_t material_bytes  = 0;
+    size_t primitive_bytes = 0;
+    size_t bvh_bytes       = 0;
+    size_t node_count      = 0;
+    size_t primitive_count = 0;
+};
+
+/*
+ * Description of a scene, collected by value so that «compile» can lay it
+ * out contiguously.  Materials are referred to by the id «add_material»
+ * returns.
+ */
+class scene
+{
+public:
+    template <typename Material, typename... Args>
+    material_id add_material( Args&&... args )
+    {
+        materials.push_back( {
+            arena::footprint<Material>(),
+            [params = std::make_tuple( std::forward<Args>( args )... )]( arena& storage ) {
+                return std::apply( [&]( const auto&... values ) -> const material* {
+                    return storage.make<Material>( values... );
+                }, params );
+            } } );
+
+        return material_id( materials.size() - 1 );
+    }
+
+    void add_sphere( const point3& center, double radius, material_id mat )
+    {
+        spheres.push_back( { center, radius, mat } );
+    }
+
+    size_t material_count( void ) const { return materials.size(); }
+    size_t sphere_count( void ) const   { return spheres.size(); }
+
+    /*
+     * Build the hierarchy, then size one arena exactly and place everything
+     * in it: materials, spheres in leaf order, the leaf table and the nodes.
+     */
+    std::unique_ptr<const compiled_scene> compile( void ) const
+    {
+        std::vector<bvh_primitive> prims( spheres.size() );
+        for ( size_t i = 0; i < spheres.size(); ++i ) {
+            prims[i].box      = sphere( spheres[i].center, spheres[i].radius, nullptr ).bounding_box();
+            prims[i].centroid = prims[i].box.centroid();
+            prims[i].index    = i;
+        }
+
+        aabb bounds = bvh_bounds( prims, 0, prims.size() );
+        auto nodes  = linear_bvh::build_nodes( prims );
+
+        size_t capacity = arena::footprint<sphere>( spheres.size() )
+                          + arena::footprint<const hittable*>( spheres.size() )
+                          + arena::footprint<linear_bvh_node>( nodes.size() )
+                          + arena::footprint<linear_bvh>();
+        for ( const auto& entry : materials ) {
+            capacity += entry.footprint;
+        }
+
+        auto compiled = std::unique_ptr<compiled_scene>( new compiled_scene( capacity ) );
+        auto& storage = compiled->storage;
+
+        std::vector<const material*> placed( materials.size() );
+        for ( size_t i = 0; i < materials.size(); ++i ) {
+            placed[i] = materials[i].place( storage );
+        }
+        compiled->material_bytes = storage.used();
+
+        std::vector<const hittable*> leaves( prims.size() );
+        for ( size_t i = 0; i < prims.size(); ++i ) {
+            const auto& desc = spheres[prims[i].index];
+            leaves[i] = storage.make<sphere>( desc.center, desc.radius, placed[desc.mat] );
+        }
+        compiled->primitive_bytes = storage.used() - compiled->material_bytes;
+        compiled->primitive_count = leaves.size();
+
+        auto leaf_table = storage.copy( leaves.data(), leaves.size() );
+        auto node_table = storage.copy( nodes.data(), nodes.size() );
+
+        compiled->root       = storage.make<linear_bvh>( node_table, nodes.size(), leaf_table, bounds );
+        compiled->node_count = nodes.size();
+        compiled->bvh_bytes  = storage.used() - compiled->material_bytes - compiled->primitive_bytes;
+
+        return compiled;
+    }
+
+private:
+    struct material_entry
+    {
+        size_t                                    footprint;
+        std::function<const material*( arena& )> place;
+    };
+
+    struct sphere_entry
+    {
+        point3      center;
+        double      radius;
+        material_id mat;
+    };
+
+    std::vector<material_entry> materials;
+    std::vector<sphere_entry>   spheres;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "rtweekend.h"
+
+#include "scene_file.h"
+
+/*
+ * Convert a text scene (see «read_scene_text») to the binary form the
+ * renderer maps with --scene, or check a binary scene from elsewhere.
+ */
+
+static void usage( const char* program )
+{
+    std::cerr << "Usage: " << program << " [--no-bvh] INPUT OUTPUT\n"
+              << "       " << program << " --check FILE\n"
+              << "  --no-bvh   leave the hierarchy to be built at load; smaller files\n"
+              << "  --check    read every record of the binary scene FILE\n";
+}
+
+int main( int argc, char* argv[] )
+{
+    if ( argc == 3 && std::strcmp( argv[1], "--check" ) == 0 ) {
+        mapped_scene mapped;
+        if ( ! mapped.open( argv[2] ) ) { return 1; }
+
+        if ( ! mapped.check() ) {
+            std::cerr << "Scene file " << argv[2] << " has records out of range or a hierarchy too deep" << std::endl;
+            return 1;
+        }
+
+        mapped.report( std::clog );
+        return 0;
+    }
+
+    bool with_bvh = true;
+    int  arg      = 1;
+    if ( arg < argc && std::strcmp( argv[arg], "--no-bvh" ) == 0 ) {
+        with_bvh = false;
+        ++arg;
+    }
+
+    if ( argc - arg != 2 ) {
+        usage( argv[0] );
+        return 1;
+    }
+
+    const char* input  = argv[arg];
+    const char* output = argv[arg + 1];
+
+    std::ifstream in( input );
+    if ( ! in ) {
+        std::cerr << "Error reading scene " << input << std::endl;
+        return 1;
+    }
+
+    scene_description desc;
+    if ( ! read_scene_text( in, desc ) ) {
+        std::cerr << "Error in scene " << input << std::endl;
+        return 1;
+    }
+
+    if ( ! write_scene_file( desc, output, with_bvh ) ) {
+        std::cerr << "Error writing scene file " << output << std::endl;
+        return 1;
+    }
+
+    std::clog << "Wrote " << desc.materials.size() << " materials and " << desc.spheres.size()
+              << " spheres to " << output << ( with_bvh ? " with" : " without" ) << " a hierarchy\n";
+
+    return 0;
+}
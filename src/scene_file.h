@@ -0,0 +1,628 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "rtweekend.h"
+#include "arena.h"
+#include "bvh.h"
+#include "camera.h"
+#include "linear_bvh.h"
+#include "material.h"
+#include "sphere.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Binary scene files, laid out to be used where they lie: a header, then
+ * sections of fixed-size records, each starting on a 64-byte boundary.
+ * Loading maps the file and points the renderer at the sphere and node
+ * records in place, so startup costs the same for ten spheres or ten
+ * million; pages are read as rays first reach them.  Only materials, which
+ * need vtables, are built at load, and the hierarchy when the file has none.
+ *
+ * Numbers are in the byte order of the machine that wrote the file, and
+ * geometry in double precision whatever «real» is.  Files are written by
+ * «write_scene_file», e.g. through scene_convert from the text form that
+ * «read_scene_text» reads.
+ */
+
+struct scene_camera_record
+{
+    double       aspect_ratio      = 1.0;
+    std::int32_t image_width       = 100;
+    std::int32_t samples_per_pixel = 10;
+    std::int32_t max_depth         = 10;
+    std::int32_t pad               = 0;
+
+    double v_fov        = 90;
+    double look_from[3] = { 0, 0,  0 };
+    double look_at[3]   = { 0, 0, -1 };
+    double v_up[3]      = { 0, 1,  0 };
+
+    double defocus_angle  = 0;
+    double focus_distance = 10;
+};
+
+struct scene_material_record
+{
+    std::uint32_t kind;         /* «kind_id» of lambertian, metal or dielectric */
+    std::uint32_t pad;
+    double        albedo[3];
+    double        param;        /* Fuzz of a metal, refraction index of a dielectric */
+};
+
+struct scene_sphere_record
+{
+    double        center[3];
+    double        radius;
+    std::uint32_t material;     /* Index into the material records */
+    std::uint32_t pad;
+};
+
+struct scene_file_header
+{
+    char          magic[8];         /* "RTWSCENE" */
+    std::uint32_t byte_order;       /* «scene_file_byte_order» as written */
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint32_t pad;
+
+    scene_camera_record camera;
+
+    /* Byte offset from the start of the file and record count of each section */
+    std::uint64_t material_offset, material_count;
+    std::uint64_t sphere_offset, sphere_count;
+    std::uint64_t node_offset, node_count;
+
+    double bounds_min[3];
+    double bounds_max[3];
+};
+
+const std::uint32_t scene_file_byte_order = 0x01020304;
+const std::uint32_t scene_file_version    = 1;
+const std::uint32_t scene_file_has_bvh    = 1;      /* Spheres are in leaf order of the node section */
+const std::size_t   scene_file_alignment  = 64;
+const std::int32_t  scene_max_image_side  = 1 << 16;
+
+/*
+ * Whether «c» gives an image the renderer can allocate and sample: a finite,
+ * positive aspect ratio, sides of 1 to «scene_max_image_side» pixels, and at
+ * least one sample and one bounce per pixel.
+ */
+inline bool scene_camera_valid( const scene_camera_record& c )
+{
+    return std::isfinite( c.aspect_ratio ) && c.aspect_ratio > 0
+           && c.image_width >= 1 && c.image_width <= scene_max_image_side
+           && c.image_width / c.aspect_ratio <= scene_max_image_side
+           && c.samples_per_pixel >= 1 && c.max_depth >= 1;
+}
+
+/* What a scene file holds, in memory */
+struct scene_description
+{
+    scene_camera_record                camera;
+    std::vector<scene_material_record> materials;
+    std::vector<scene_sphere_record>   spheres;
+};
+
+/*
+ * Parse the text form of a scene, one item per line; '#' starts a comment.
+ *
+ *     camera aspect_ratio 1.7778       (also image_width, samples_per_pixel,
+ *     camera look_from 13 2 3           max_depth, v_fov, look_at, v_up,
+ *     lambertian 0.5 0.5 0.5            defocus_angle, focus_distance)
+ *     metal 0.7 0.6 0.5 0.0            (albedo, fuzz)
+ *     dielectric 1.5                   (refraction index)
+ *     sphere 0 -1000 0 1000 0          (center, radius, material)
+ *
+ * Materials are numbered from 0 in the order they appear; a sphere may only
+ * use one defined above it.  Errors go to std::cerr with their line number.
+ */
+inline bool read_scene_text( std::istream& in, scene_description& desc )
+{
+    std::string line;
+    int         line_number = 0;
+
+    while ( std::getline( in, line ) ) {
+        ++line_number;
+
+        auto comment = line.find( '#' );
+        if ( comment != std::string::npos ) { line.erase( comment ); }
+
+        /* Words and numbers, read in place: big scenes have millions of lines */
+        const char* cursor = line.c_str();
+        bool        valid  = true;
+
+        auto word = [&]( void ) {
+            while ( *cursor == ' ' || *cursor == '\t' || *cursor == '\r' ) { ++cursor; }
+            const char* start = cursor;
+            while ( *cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' ) { ++cursor; }
+            return std::string( start, cursor );
+        };
+        auto numbers = [&]( double* values, int count ) {
+            for ( int i = 0; i < count; ++i ) {
+                char* end;
+                values[i] = std::strtod( cursor, &end );
+                valid     = valid && end != cursor;
+                cursor    = end;
+            }
+        };
+
+        std::string keyword = word();
+        if ( keyword.empty() ) { continue; }
+
+        double values[5] = {};
+
+        if ( keyword == "sphere" ) {
+            numbers( values, 5 );
+            bool known = values[4] >= 0 && values[4] < double( desc.materials.size() )
+                         && values[4] == std::trunc( values[4] );
+            if ( valid && ! known ) {
+                std::cerr << "Line " << line_number << ": no material " << values[4] << std::endl;
+                return false;
+            }
+
+            scene_sphere_record record = {};
+            std::memcpy( record.center, values, sizeof( record.center ) );
+            record.radius   = values[3];
+            record.material = std::uint32_t( values[4] );
+            desc.spheres.push_back( record );
+        } else if ( keyword == "lambertian" || keyword == "metal" ) {
+            bool is_metal = keyword == "metal";
+            numbers( values, is_metal ? 4 : 3 );
+
+            scene_material_record material = {};
+            material.kind  = is_metal ? metal::kind_id : lambertian::kind_id;
+            std::memcpy( material.albedo, values, sizeof( material.albedo ) );
+            material.param = values[3];
+            desc.materials.push_back( material );
+        } else if ( keyword == "dielectric" ) {
+            numbers( values, 1 );
+
+            scene_material_record material = {};
+            material.kind  = dielectric::kind_id;
+            material.param = values[0];
+            desc.materials.push_back( material );
+        } else if ( keyword == "camera" ) {
+            auto& cam   = desc.camera;
+            auto  field = word();
+
+            auto integer = [&]( std::int32_t& target ) {
+                numbers( values, 1 );
+                valid = valid && values[0] == std::trunc( values[0] ) && std::fabs( values[0] ) <= INT32_MAX;
+                if ( valid ) { target = std::int32_t( values[0] ); }
+            };
+
+            if ( field == "aspect_ratio" )           { numbers( &cam.aspect_ratio, 1 ); }
+            else if ( field == "image_width" )       { integer( cam.image_width ); }
+            else if ( field == "samples_per_pixel" ) { integer( cam.samples_per_pixel ); }
+            else if ( field == "max_depth" )         { integer( cam.max_depth ); }
+            else if ( field == "v_fov" )             { numbers( &cam.v_fov, 1 ); }
+            else if ( field == "look_from" )         { numbers( cam.look_from, 3 ); }
+            else if ( field == "look_at" )           { numbers( cam.look_at, 3 ); }
+            else if ( field == "v_up" )              { numbers( cam.v_up, 3 ); }
+            else if ( field == "defocus_angle" )     { numbers( &cam.defocus_angle, 1 ); }
+            else if ( field == "focus_distance" )    { numbers( &cam.focus_distance, 1 ); }
+            else {
+                std::cerr << "Line " << line_number << ": unknown camera field '" << field << "'" << std::endl;
+                return false;
+            }
+        } else {
+            std::cerr << "Line " << line_number << ": unknown item '" << keyword << "'" << std::endl;
+            return false;
+        }
+
+        if ( ! valid ) {
+            std::cerr << "Line " << line_number << ": missing or malformed number" << std::endl;
+            return false;
+        }
+    }
+
+    if ( ! scene_camera_valid( desc.camera ) ) {
+        std::cerr << "The camera's aspect ratio, image width, samples per pixel or max depth is out of range"
+                  << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/* Bounds of the spheres in «desc», one box per sphere in file order */
+inline std::vector<bvh_primitive> scene_primitives( const std::vector<scene_sphere_record>& spheres )
+{
+    std::vector<bvh_primitive> prims( spheres.size() );
+
+    for ( size_t i = 0; i < spheres.size(); ++i ) {
+        const auto& s = spheres[i];
+        point3 center( real( s.center[0] ), real( s.center[1] ), real( s.center[2] ) );
+
+        prims[i].box      = sphere( center, real( s.radius ), nullptr ).bounding_box();
+        prims[i].centroid = prims[i].box.centroid();
+        prims[i].index    = i;
+    }
+
+    return prims;
+}
+
+/*
+ * Write «desc» to «path».  With «with_bvh» the hierarchy is built now and
+ * stored, and the spheres written in its leaf order, so loading builds
+ * nothing.
+ */
+inline bool write_scene_file( const scene_description& desc, const std::string& path, bool with_bvh )
+{
+    scene_file_header header = {};
+    std::memcpy( header.magic, "RTWSCENE", sizeof( header.magic ) );
+    header.byte_order = scene_file_byte_order;
+    header.version    = scene_file_version;
+    header.camera     = desc.camera;
+
+    auto prims  = scene_primitives( desc.spheres );
+    aabb bounds = bvh_bounds( prims, 0, prims.size() );
+    for ( int axis = 0; axis < 3; ++axis ) {
+        header.bounds_min[axis] = bounds.axis_interval( axis ).min;
+        header.bounds_max[axis] = bounds.axis_interval( axis ).max;
+    }
+
+    std::vector<linear_bvh_node> nodes;
+    if ( with_bvh ) {
+        nodes         = linear_bvh::build_nodes( prims );
+        header.flags |= scene_file_has_bvh;
+    }
+
+    auto align = []( std::uint64_t offset ) {
+        return ( offset + scene_file_alignment - 1 ) & ~std::uint64_t( scene_file_alignment - 1 );
+    };
+
+    header.material_count  = desc.materials.size();
+    header.material_offset = align( sizeof( header ) );
+    header.sphere_count    = desc.spheres.size();
+    header.sphere_offset   = align( header.material_offset + ( header.material_count * sizeof( scene_material_record ) ) );
+    header.node_count      = nodes.size();
+    header.node_offset     = align( header.sphere_offset + ( header.sphere_count * sizeof( scene_sphere_record ) ) );
+
+    std::ofstream out( path, std::ios::binary );
+
+    /* Sections follow each other in order; the gaps between them are zeros */
+    std::uint64_t written = 0;
+    auto write_at = [&]( std::uint64_t offset, const void* data, std::uint64_t size ) {
+        static const char zeros[scene_file_alignment] = {};
+        out.write( zeros, std::streamsize( offset - written ) );
+        out.write( static_cast<const char*>( data ), std::streamsize( size ) );
+        written = offset + size;
+    };
+
+    write_at( 0, &header, sizeof( header ) );
+    write_at( header.material_offset, desc.materials.data(), header.material_count * sizeof( scene_material_record ) );
+
+    if ( with_bvh ) {
+        /* Spheres in leaf order, in blocks to bound the extra memory */
+        std::vector<scene_sphere_record> block;
+        std::uint64_t                    offset = header.sphere_offset;
+        for ( size_t i = 0; i < prims.size(); i += 1 << 16 ) {
+            block.clear();
+            for ( size_t j = i; j < std::min( prims.size(), i + ( 1 << 16 ) ); ++j ) {
+                block.push_back( desc.spheres[prims[j].index] );
+            }
+
+            write_at( offset, block.data(), block.size() * sizeof( scene_sphere_record ) );
+            offset += block.size() * sizeof( scene_sphere_record );
+        }
+    } else {
+        write_at( header.sphere_offset, desc.spheres.data(), header.sphere_count * sizeof( scene_sphere_record ) );
+    }
+
+    write_at( header.node_offset, nodes.data(), header.node_count * sizeof( linear_bvh_node ) );
+
+    return bool( out );
+}
+
+/* Closed-world view of a «mapped_scene»: spheres straight from their records */
+class mapped_sphere_world
+{
+public:
+    mapped_sphere_world( const linear_bvh& bvh, const scene_sphere_record* spheres,
+                         const material* const* materials )
+        : bvh( bvh ), spheres( spheres ), materials( materials )
+    {}
+
+    bool hit( const ray& r, interval ray_t, hit_record& rec ) const
+    {
+        return bvh.hit_leaves( r, ray_t, rec, [this]( std::uint32_t index, const ray& r, interval ray_t,
+                                                      hit_record& rec ) {
+            return hit_sphere( index, r, ray_t, rec );
+        } );
+    }
+
+    void hit_packet( const ray_packet& packet, interval ray_t, hit_record* recs, bool* hits ) const
+    {
+        bvh.hit_packet_leaves( packet, ray_t, recs, hits, [this]( std::uint32_t index, const ray& r,
+                                                                  interval ray_t, hit_record& rec ) {
+            return hit_sphere( index, r, ray_t, rec );
+        } );
+    }
+
+private:
+    const linear_bvh&          bvh;
+    const scene_sphere_record* spheres;
+    const material* const*     materials;
+
+    bool hit_sphere( std::uint32_t index, const ray& r, interval ray_t, hit_record& rec ) const
+    {
+        const auto& s = spheres[index];
+        point3 center( real( s.center[0] ), real( s.center[1] ), real( s.center[2] ) );
+        real   radius = real( s.radius );
+
+        if ( ! sphere::intersect( center, radius, r, ray_t, rec ) ) {
+            return false;
+        }
+
+        rec.p_error = sphere::point_error( center, radius );
+        rec.mat     = materials[s.material];
+
+        return true;
+    }
+};
+
+/*
+ * A scene file opened for rendering.  The header with its camera, section
+ * extents and materials are checked on «open»; sphere and node records are
+ * trusted, as reading them all would cost what mapping saves.  «check»
+ * reads them all, for files of unknown origin; rendering one unchecked can
+ * crash.
+ */
+class mapped_scene
+{
+public:
+    mapped_scene() = default;
+
+    mapped_scene( const mapped_scene& ) = delete;
+    mapped_scene& operator=( const mapped_scene& ) = delete;
+
+    ~mapped_scene() { unmap(); }
+
+    bool open( const std::string& path )
+    {
+        unmap();
+
+        if ( ! map( path ) ) {
+            std::cerr << "Error reading scene file " << path << std::endl;
+            return false;
+        }
+
+        if ( size < sizeof( scene_file_header ) ) {
+            std::cerr << "Scene file " << path << " is truncated" << std::endl;
+            return false;
+        }
+
+        std::memcpy( &header, data, sizeof( header ) );
+        if ( std::memcmp( header.magic, "RTWSCENE", sizeof( header.magic ) ) != 0
+             || header.byte_order != scene_file_byte_order || header.version != scene_file_version ) {
+            std::cerr << "Scene file " << path << " is not a scene of this version and byte order" << std::endl;
+            return false;
+        }
+
+        if ( ! scene_camera_valid( header.camera ) ) {
+            std::cerr << "Scene file " << path << " has a camera out of range" << std::endl;
+            return false;
+        }
+
+        if ( ! section_fits( header.material_offset, header.material_count, sizeof( scene_material_record ) )
+             || ! section_fits( header.sphere_offset, header.sphere_count, sizeof( scene_sphere_record ) )
+             || ! section_fits( header.node_offset, header.node_count, sizeof( linear_bvh_node ) )
+             || header.sphere_count > UINT32_MAX
+             || ( ( header.flags & scene_file_has_bvh ) != 0 ) != ( header.node_count > 0 ) ) {
+            std::cerr << "Scene file " << path << " is truncated or corrupt" << std::endl;
+            return false;
+        }
+
+        if ( ! place_materials() ) {
+            std::cerr << "Scene file " << path << " has an unknown material" << std::endl;
+            return false;
+        }
+
+        spheres = reinterpret_cast<const scene_sphere_record*>( data + header.sphere_offset );
+        nodes   = reinterpret_cast<const linear_bvh_node*>( data + header.node_offset );
+
+        if ( header.node_count == 0 ) {
+            build_hierarchy();
+        }
+
+        aabb bounds( point3( real( header.bounds_min[0] ), real( header.bounds_min[1] ), real( header.bounds_min[2] ) ),
+                     point3( real( header.bounds_max[0] ), real( header.bounds_max[1] ), real( header.bounds_max[2] ) ) );
+        bvh = std::make_unique<linear_bvh>( nodes, node_count(), nullptr, bounds );
+
+        return true;
+    }
+
+    /*
+     * Every record in range: material indices, node offsets and counts, and a
+     * hierarchy no deeper than traversal can follow.
+     */
+    bool check( void ) const
+    {
+        for ( size_t i = 0; i < header.sphere_count; ++i ) {
+            if ( spheres[i].material >= header.material_count ) { return false; }
+        }
+
+        size_t count = node_count();
+        for ( size_t i = 0; i < count; ++i ) {
+            const auto& node = nodes[i];
+            bool in_range = node.count > 0 ? std::uint64_t( node.offset ) + node.count <= header.sphere_count
+                                           : node.offset > i && node.offset < count && i + 1 < count;
+            if ( ! in_range ) { return false; }
+        }
+
+        return linear_bvh::depth( nodes, count ) <= linear_bvh::max_depth;
+    }
+
+    mapped_sphere_world world( void ) const
+    {
+        return mapped_sphere_world( *bvh, spheres, placed.data() );
+    }
+
+    /* Set the fields of «cam» the file has */
+    void apply_camera( camera& cam ) const
+    {
+        const auto& c = header.camera;
+
+        cam.aspect_ratio      = c.aspect_ratio;
+        cam.image_width       = c.image_width;
+        cam.samples_per_pixel = c.samples_per_pixel;
+        cam.max_depth         = c.max_depth;
+
+        cam.v_fov     = c.v_fov;
+        cam.look_from = point3( real( c.look_from[0] ), real( c.look_from[1] ), real( c.look_from[2] ) );
+        cam.look_at   = point3( real( c.look_at[0] ), real( c.look_at[1] ), real( c.look_at[2] ) );
+        cam.v_up      = vec3( real( c.v_up[0] ), real( c.v_up[1] ), real( c.v_up[2] ) );
+
+        cam.defocus_angle  = c.defocus_angle;
+        cam.focus_distance = c.focus_distance;
+    }
+
+    size_t sphere_count( void ) const   { return size_t( header.sphere_count ); }
+    size_t material_count( void ) const { return size_t( header.material_count ); }
+
+    void report( std::ostream& out ) const
+    {
+        out << "Scene: " << size << " bytes " << ( mapped ? "mapped" : "read" ) << " ("
+            << header.material_count << " materials, " << header.sphere_count << " spheres, "
+            << node_count() << " nodes" << ( node_storage.empty() ? "" : " built at load" ) << ")\n";
+    }
+
+private:
+    scene_file_header header = {};
+
+    const unsigned char*       data   = nullptr;
+    size_t                     size   = 0;
+    bool                       mapped = false;
+    std::vector<unsigned char> buffer;             /* The file, where it could not be mapped */
+
+    std::unique_ptr<arena>       material_storage;
+    std::vector<const material*> placed;
+
+    const scene_sphere_record*       spheres = nullptr;
+    const linear_bvh_node*           nodes   = nullptr;
+    std::vector<scene_sphere_record> sphere_storage;    /* Leaf order, for files without a hierarchy */
+    std::vector<linear_bvh_node>     node_storage;
+    std::unique_ptr<linear_bvh>      bvh;
+
+    size_t node_count( void ) const
+    {
+        return node_storage.empty() ? size_t( header.node_count ) : node_storage.size();
+    }
+
+    bool section_fits( std::uint64_t offset, std::uint64_t count, std::uint64_t record_size ) const
+    {
+        return offset % alignof( double ) == 0 && offset <= size && count <= ( size - offset ) / record_size;
+    }
+
+    bool map( const std::string& path )
+    {
+#if defined( __unix__ ) || defined( __APPLE__ )
+        int fd = ::open( path.c_str(), O_RDONLY );
+        if ( fd < 0 ) { return false; }
+
+        struct stat info;
+        if ( ::fstat( fd, &info ) == 0 && info.st_size > 0 ) {
+            void* view = ::mmap( nullptr, size_t( info.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+            if ( view != MAP_FAILED ) {
+                data   = static_cast<const unsigned char*>( view );
+                size   = size_t( info.st_size );
+                mapped = true;
+            }
+        }
+        ::close( fd );
+
+        if ( mapped ) { return true; }
+#endif
+
+        std::ifstream in( path, std::ios::binary );
+        if ( ! in ) { return false; }
+
+        buffer.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+        data = buffer.data();
+        size = buffer.size();
+
+        return true;
+    }
+
+    void unmap( void )
+    {
+#if defined( __unix__ ) || defined( __APPLE__ )
+        if ( mapped ) { ::munmap( const_cast<unsigned char*>( data ), size ); }
+#endif
+        data   = nullptr;
+        size   = 0;
+        mapped = false;
+        buffer.clear();
+    }
+
+    bool place_materials( void )
+    {
+        auto records = reinterpret_cast<const scene_material_record*>( data + header.material_offset );
+        size_t count = size_t( header.material_count );
+
+        size_t capacity = 0;
+        for ( size_t i = 0; i < count; ++i ) {
+            switch ( records[i].kind ) {
+            case lambertian::kind_id: capacity += arena::footprint<lambertian>(); break;
+            case metal::kind_id:      capacity += arena::footprint<metal>();      break;
+            case dielectric::kind_id: capacity += arena::footprint<dielectric>(); break;
+            default:                  return false;
+            }
+        }
+
+        material_storage = std::make_unique<arena>( capacity );
+        placed.resize( count );
+
+        for ( size_t i = 0; i < count; ++i ) {
+            const auto& m = records[i];
+            color albedo( real( m.albedo[0] ), real( m.albedo[1] ), real( m.albedo[2] ) );
+
+            switch ( m.kind ) {
+            case lambertian::kind_id: placed[i] = material_storage->make<lambertian>( albedo );          break;
+            case metal::kind_id:      placed[i] = material_storage->make<metal>( albedo, m.param );      break;
+            default:                  placed[i] = material_storage->make<dielectric>( m.param );         break;
+            }
+        }
+
+        return true;
+    }
+
+    /* No stored hierarchy: build one and keep a leaf-ordered copy of the spheres */
+    void build_hierarchy( void )
+    {
+        std::vector<scene_sphere_record> file_order( spheres, spheres + header.sphere_count );
+
+        auto prims   = scene_primitives( file_order );
+        node_storage = linear_bvh::build_nodes( prims );
+
+        sphere_storage.resize( prims.size() );
+        for ( size_t i = 0; i < prims.size(); ++i ) {
+            sphere_storage[i] = file_order[prims[i].index];
+        }
+
+        spheres = sphere_storage.data();
+        nodes   = node_storage.data();
+    }
+};
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rtweekend.h"
+#include "camera.h"
+#include "color.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "material.h"
+#include "scene.h"
+#include "sphere.h"
+#include "transform.h"
+#include "vec3.h"
+
+/* Materials of the small spheres in «random_spheres» */
+enum class sphere_mix
+{
+    mixed,          /* 80% diffuse, 15% metal, 5% glass */
+    dielectric,
+    metal
+};
+
+/*
+ * The cover scene of the book: a ground sphere, small spheres on a grid of
+ * (2 «half_extent»)² cells and three large spheres.  Each material makes its
+ * own random draws, so layouts differ slightly between mixes.
+ */
+inline void random_spheres( scene& world, rng& gen, int half_extent = 11,
+                            sphere_mix mix = sphere_mix::mixed )
+{
+    auto material_ground = world.add_material<lambertian>( color( 0.5, 0.5, 0.5 ) );
+    world.add_sphere( point3( 0, -1000, 0 ), 1000, material_ground );
+
+    for ( int a = -half_extent; a < half_extent; ++a ) {
+        for ( int b = -half_extent; b < half_extent; ++b ) {
+            auto choose_mat = random_double( gen );
+            point3 center( a + ( 0.9 * random_double( gen ) ),
+                           0.2,
+                           b + ( 0.9 * random_double( gen ) ) );
+
+            if ( ( center - point3( 4, 0.2, 0 ) ).length() > 0.9 ) {
+                material_id sphere_material;
+
+                if ( mix == sphere_mix::dielectric ) {
+                    choose_mat = 1;
+                } else if ( mix == sphere_mix::metal ) {
+                    choose_mat = 0.9;
+                }
+
+                if ( choose_mat < 0.8 ) {
+                    /* Diffuse */
+                    auto albedo     = color::random( gen ) * color::random( gen );
+                    sphere_material = world.add_material<lambertian>( albedo );
+                } else if ( choose_mat < 0.95 ) {
+                    /* Metal */
+                    auto albedo     = color::random( gen, 0.5, 1 );
+                    auto fuzz       = random_double( gen, 0, 0.5 );
+                    sphere_material = world.add_material<metal>( albedo, fuzz );
+                } else {
+                    /* Glass */
+                    sphere_material = world.add_material<dielectric>( 1.5 );
+                }
+
+                world.add_sphere( center, 0.2, sphere_material );
+            }
+        }
+    }
+
+    auto material_1 = world.add_material<dielectric>( 1.5 );
+    world.add_sphere( point3( 0, 1, 0 ), 1.0, material_1 );
+
+    auto material_2 = world.add_material<lambertian>( color( 0.4, 0.2, 0.1 ) );
+    world.add_sphere( point3( -4, 1, 0 ), 1.0, material_2 );
+
+    auto material_3 = world.add_material<metal>( color( 0.7, 0.6, 0.5 ), 0.0 );
+    world.add_sphere( point3( 4, 1, 0 ), 1.0, material_3 );
+}
+
+
+/*
+ * The cover's small spheres alone, on the (2 «half_extent»)² cells around
+ * the origin, moved by «placement»: a tile for building larger scenes.
+ * Cells under the cover's large spheres stay empty.
+ */
+inline void sphere_tile( scene& world, rng& gen, int half_extent, const transform& placement = transform() )
+{
+    for ( int a = -half_extent; a < half_extent; ++a ) {
+        for ( int b = -half_extent; b < half_extent; ++b ) {
+            auto   choose_mat = random_double( gen );
+            point3 center( a + ( 0.9 * random_double( gen ) ), 0.2, b + ( 0.9 * random_double( gen ) ) );
+
+            real clearance = std::fmin( std::fmin( ( center - point3( -4, 0.2, 0 ) ).length(),
+                                                   ( center - point3( 0, 0.2, 0 ) ).length() ),
+                                        ( center - point3( 4, 0.2, 0 ) ).length() );
+            if ( clearance < 1.3 ) {
+                continue;
+            }
+
+            material_id sphere_material;
+            if ( choose_mat < 0.8 ) {
+                auto albedo     = color::random( gen ) * color::random( gen );
+                sphere_material = world.add_material<lambertian>( albedo );
+            } else if ( choose_mat < 0.95 ) {
+                auto albedo     = color::random( gen, 0.5, 1 );
+                auto fuzz       = random_double( gen, 0, 0.5 );
+                sphere_material = world.add_material<metal>( albedo, fuzz );
+            } else {
+                sphere_material = world.add_material<dielectric>( 1.5 );
+            }
+
+            world.add_sphere( placement.point( center ), 0.2, sphere_material );
+        }
+    }
+}
+
+/*
+ * Placement of tile «index» of a «copies» × «copies» grid of sphere tiles
+ * centred on the origin, every other one turned around so that the
+ * repetition is less obvious.
+ */
+inline transform tile_placement( int index, int copies, int half_extent )
+{
+    double size = 2 * half_extent;
+    vec3   offset( real( ( ( index % copies ) - ( ( copies - 1 ) / 2.0 ) ) * size ), 0,
+                   real( ( ( index / copies ) - ( ( copies - 1 ) / 2.0 ) ) * size ) );
+
+    return transform::translate( offset ) * transform::rotate( vec3( 0, 1, 0 ), 180.0 * ( ( index + ( index / copies ) ) % 2 ) );
+}
+
+/* Ground and the three large spheres of the cover, the ground grown to hold «copies»² tiles */
+inline void cover_props( scene& world, int copies )
+{
+    double ground_radius = 1000.0 * copies * copies;
+
+    auto material_ground = world.add_material<lambertian>( color( 0.5, 0.5, 0.5 ) );
+    world.add_sphere( point3( 0, real( -ground_radius ), 0 ), ground_radius, material_ground );
+
+    world.add_sphere( point3( 0, 1, 0 ), 1.0, world.add_material<dielectric>( 1.5 ) );
+    world.add_sphere( point3( -4, 1, 0 ), 1.0, world.add_material<lambertian>( color( 0.4, 0.2, 0.1 ) ) );
+    world.add_sphere( point3( 4, 1, 0 ), 1.0, world.add_material<metal>( color( 0.7, 0.6, 0.5 ), 0.0 ) );
+}
+
+/*
+ * The cover scene stretched to «copies» × «copies» tiles of small spheres,
+ * all instances of one prototype tile.
+ */
+inline void instanced_spheres( instanced_scene& world, int copies, int half_extent = 11 )
+{
+    scene tile, props;
+    rng   gen;
+    sphere_tile( tile, gen, half_extent );
+    cover_props( props, copies );
+
+    auto tile_id  = world.add_prototype( tile.compile() );
+    auto props_id = world.add_prototype( props.compile() );
+
+    for ( int index = 0; index < copies * copies; ++index ) {
+        world.add_instance( tile_id, tile_placement( index, copies, half_extent ) );
+    }
+    world.add_instance( props_id, transform() );
+
+    world.build();
+}
+
+/* The same geometry as «instanced_spheres», every sphere stored on its own */
+inline void flat_spheres( scene& world, int copies, int half_extent = 11 )
+{
+    for ( int index = 0; index < copies * copies; ++index ) {
+        rng gen;
+        sphere_tile( world, gen, half_extent, tile_placement( index, copies, half_extent ) );
+    }
+    cover_props( world, copies );
+}
+
+/*
+ * «mesh» resting on a ground sphere of «ground», framed by the camera from
+ * the front, above and to the right, whatever the mesh's size and place.
+ */
+inline void mesh_stage( hittable_list& world, shared_ptr<hittable> mesh, const material* ground, camera& cam )
+{
+    aabb   box = mesh->bounding_box();
+    point3 center( 0.5 * ( box.x.min + box.x.max ), 0.5 * ( box.y.min + box.y.max ), 0.5 * ( box.z.min + box.z.max ) );
+    real   radius = 0.5 * ( point3( box.x.max, box.y.max, box.z.max ) - point3( box.x.min, box.y.min, box.z.min ) ).length();
+
+    world.add( mesh );
+
+    real ground_radius = 1000 * radius;
+    world.add( make_shared<sphere>( point3( center.x(), box.y.min - ground_radius, center.z() ), ground_radius, ground ) );
+
+    /* Far enough for the bounding sphere to fit the vertical field of view */
+    real distance = radius / real( std::sin( degrees_to_radians( cam.v_fov / 2 ) ) );
+
+    cam.look_at        = center;
+    cam.look_from      = center + ( distance * unit_vector( vec3( 0.6, 0.45, 1 ) ) );
+    cam.v_up           = vec3( 0, 1, 0 );
+    cam.defocus_angle  = 0;
+    cam.focus_distance = distance;
+}
+
+#endif
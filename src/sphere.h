@@ -5,16 +5,53 @@
 #include "vec3.h"
 #include "material.h"
 
-#include <memory>
+#include <limits>
 
 class sphere : public hittable
 {
 public:
-    sphere( const point3& center, double radius, std::shared_ptr<material> mat )
-        : center( center ), radius( std::fmax( 0, radius ) ), mat( mat ) {}
+    sphere( const point3& center, real radius, const material* mat )
+        : center( center ), radius( std::fmax( real( 0 ), radius ) ), mat( mat )
+    {
+        auto r_vec = vec3( this->radius, this->radius, this->radius );
+        bbox = aabb( center - r_vec, center + r_vec );
+
+        p_error = point_error( center, this->radius );
+    }
+
+    /*
+     * Error bound of a hit point reprojected onto the sphere, «center» plus
+     * «radius» times a unit vector: a few roundings of the sphere's extent.
+     */
+    static real point_error( const point3& center, real radius )
+    {
+        real extent = std::fmax( std::fmax( std::fabs( center.x() ), std::fabs( center.y() ) ),
+                                 std::fabs( center.z() ) ) + radius;
+
+        return 8 * std::numeric_limits<real>::epsilon() * extent;
+    }
 
     bool hit( const ray& r, interval ray_t, hit_record& rec ) const override
     {
+        if ( ! intersect( center, radius, r, ray_t, rec ) ) {
+            return false;
+        }
+
+        rec.p_error = p_error;
+        rec.mat     = mat;
+
+        return true;
+    }
+
+    /*
+     * Nearest intersection of «r» within «ray_t» with the sphere («center»,
+     * «radius»), for spheres stored in other forms too.  Sets «rec» but for
+     * its material and «p_error», which are the caller's.
+     */
+    static bool intersect( const point3& center, real radius, const ray& r, interval ray_t, hit_record& rec )
+    {
+        RTW_STAT( ++stats::local().sphere_tests );
+
         vec3 oc = center - r.origin();
         auto a  = r.direction().length_squared();
         auto h  = dot( r.direction(), oc );
@@ -36,19 +73,28 @@ public:
             }
         }
 
+        /* Projecting the hit onto the sphere bounds its error independently of t */
+        vec3 outward_normal = unit_vector( r.at( root ) - center );
+
         rec.t = root;
-        rec.p = r.at( rec.t );
-        vec3 outward_normal = ( rec.p - center ) / radius;
+        rec.p = center + ( radius * outward_normal );
         rec.set_face_normal( r, outward_normal );
-        rec.mat = mat;
+
+        RTW_STAT( ++stats::local().sphere_hits );
 
         return true;
     }
 
+    aabb bounding_box() const override { return bbox; }
+
 private:
-    point3               center;
-    double               radius;
-    shared_ptr<material> mat;
+    friend class sphere_soa;
+
+    point3          center;
+    real            radius;
+    real            p_error;
+    const material* mat;
+    aabb            bbox;
 };
 
 #endif
@@ -0,0 +1,569 @@
+#ifndef SPHERE_SOA_H
+#define SPHERE_SOA_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+#include "material.h"
+#include "sphere.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define SPHERE_SOA_X86 1
+#include <immintrin.h>
+#endif
+
+/* Allocator for vectors whose data has to be aligned for full-width SIMD loads */
+template <typename T, std::size_t Alignment>
+struct aligned_allocator
+{
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = aligned_allocator<U, Alignment>; };
+
+    aligned_allocator() = default;
+
+    template <typename U>
+    aligned_allocator( const aligned_allocator<U, Alignment>& ) {}
+
+    T* allocate( std::size_t n )
+    {
+        return static_cast<T*>( ::operator new( n * sizeof( T ), std::align_val_t( Alignment ) ) );
+    }
+
+    void deallocate( T* p, std::size_t )
+    {
+        ::operator delete( p, std::align_val_t( Alignment ) );
+    }
+
+    bool operator ==( const aligned_allocator& ) const { return true; }
+    bool operator !=( const aligned_allocator& ) const { return false; }
+};
+
+/*
+ * A set of spheres stored as a structure of arrays, intersected several
+ * spheres at a time.  The widest kernel the CPU supports (AVX-512, AVX2 or
+ * SSE2, i.e. 8, 4 or 2 doubles per instruction) is picked at run time.
+ *
+ * Each lane evaluates exactly the arithmetic of «sphere::hit», so the closest
+ * hit, including ties (the earlier sphere wins), matches a «hittable_list» of
+ * the same spheres.  With RTW_FLOAT the lanes still work in double, so hits
+ * can differ from «sphere::hit» in the last bits.
+ *
+ * Spheres live in slots.  «begin_leaf» pads to a block of «leaf_width»
+ * slots, so that a hierarchy's leaf of up to that many spheres is tested by
+ * «hit_leaf» in one block, as «sphere_soa_bvh» does.
+ */
+class sphere_soa : public hittable
+{
+public:
+    /* Spheres in a block that «hit_leaf» tests at once */
+    static constexpr size_t leaf_width = 8;
+
+    sphere_soa() : kernel( select_kernel() ) {}
+
+    void add( const point3& center, double radius, const material* mat )
+    {
+        radius = std::fmax( 0, radius );
+
+        /* Overwrite the trailing padding, then pad up to the block width again */
+        trim();
+        append( center.x(), center.y(), center.z(), radius * radius, radius, mat );
+        ++count;
+        pad();
+
+        auto r_vec = vec3( real( radius ), real( radius ), real( radius ) );
+        bbox = aabb( bbox, aabb( center - r_vec, center + r_vec ) );
+    }
+
+    /* «add» the sphere «s» */
+    void add( const sphere& s ) { add( s.center, s.radius, s.mat ); }
+
+    /* Pad to the next block of «leaf_width» slots; returns the slot the next sphere goes to */
+    size_t begin_leaf( void )
+    {
+        trim();
+        while ( slots % leaf_width != 0 ) { append_padding(); }
+        pad();
+
+        return slots;
+    }
+
+    size_t size( void ) const { return count; }
+
+    /* Bytes of the arrays, padding included */
+    size_t footprint( void ) const
+    {
+        return ( center_x.size() * 5 * sizeof( double ) ) + ( materials.size() * sizeof( const material* ) );
+    }
+
+    bool hit( const ray& r, interval ray_t, hit_record& rec ) const override
+    {
+        double t;
+        long   index = kernel( *this, 0, center_x.size(), r, ray_t, t );
+
+        return index >= 0 && fill( size_t( index ), t, r, rec );
+    }
+
+    /* «hit» among the block of «leaf_width» slots from «slot», which «begin_leaf» returned */
+    bool hit_leaf( size_t slot, const ray& r, interval ray_t, hit_record& rec ) const
+    {
+        double t;
+        long   index = kernel( *this, slot, slot + leaf_width, r, ray_t, t );
+
+        return index >= 0 && fill( size_t( index ), t, r, rec );
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    /* Name of the instruction set the intersector runs on */
+    static const char* isa( void )
+    {
+#ifdef SPHERE_SOA_X86
+        if ( __builtin_cpu_supports( "avx512f" ) ) { return "avx512"; }
+        if ( __builtin_cpu_supports( "avx2" ) )    { return "avx2"; }
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+private:
+    /* Every array is padded to a multiple of the widest kernel */
+    static constexpr size_t block_width = 8;
+
+    static_assert( leaf_width % block_width == 0, "leaf blocks must suit every kernel" );
+
+    template <typename T>
+    using aligned_vector = std::vector<T, aligned_allocator<T, 64>>;
+
+    aligned_vector<double> center_x, center_y, center_z;
+    aligned_vector<double> radius_sq;
+    aligned_vector<double> radii;
+
+    std::vector<const material*> materials;     /* Per slot; null for padding */
+    size_t                       count = 0;     /* Spheres */
+    size_t                       slots = 0;     /* Slots up to the last sphere, padding between leaves included */
+    aabb                         bbox;
+
+    /* Returns the index of the closest sphere hit among slots [begin, end) within «ray_t», or -1 */
+    using kernel_fn = long (*)( const sphere_soa&, size_t, size_t, const ray&, interval, double& );
+
+    kernel_fn kernel;
+
+    void append( double x, double y, double z, double r_sq, double r, const material* mat )
+    {
+        center_x.push_back( x );
+        center_y.push_back( y );
+        center_z.push_back( z );
+        radius_sq.push_back( r_sq );
+        radii.push_back( r );
+        materials.push_back( mat );
+        ++slots;
+    }
+
+    /* Padding spheres have an infinitely negative squared radius: never hit */
+    void append_padding( void ) { append( 0, 0, 0, -infinity, 0, nullptr ); }
+
+    void trim( void )
+    {
+        center_x.resize( slots ); center_y.resize( slots ); center_z.resize( slots );
+        radius_sq.resize( slots ); radii.resize( slots ); materials.resize( slots );
+    }
+
+    void pad( void )
+    {
+        size_t used = slots;
+        while ( center_x.size() % block_width != 0 ) { append_padding(); }
+        slots = used;
+    }
+
+    bool fill( size_t index, double t, const ray& r, hit_record& rec ) const
+    {
+        point3 center( real( center_x[index] ), real( center_y[index] ), real( center_z[index] ) );
+        vec3   outward_normal = unit_vector( r.at( real( t ) ) - center );
+
+        rec.t       = real( t );
+        rec.p       = center + ( real( radii[index] ) * outward_normal );
+        rec.p_error = sphere::point_error( center, real( radii[index] ) );
+        rec.set_face_normal( r, outward_normal );
+        rec.mat = materials[index];
+
+        return true;
+    }
+
+    static kernel_fn select_kernel( void )
+    {
+#ifdef SPHERE_SOA_X86
+        if ( __builtin_cpu_supports( "avx512f" ) ) { return hit_avx512; }
+        if ( __builtin_cpu_supports( "avx2" ) )    { return hit_avx2; }
+#if defined( __SSE2__ )
+        return hit_sse2;
+#endif
+#endif
+        return hit_scalar;
+    }
+
+    static long hit_scalar( const sphere_soa& s, size_t begin, size_t end, const ray& r, interval ray_t, double& t )
+    {
+        const point3& o = r.origin();
+        const vec3&   d = r.direction();
+        double        a = d.length_squared();
+
+        long   best   = -1;
+        double best_t = ray_t.max;
+
+        for ( size_t i = begin; i < end; ++i ) {
+            double ocx = s.center_x[i] - o.x(), ocy = s.center_y[i] - o.y(), ocz = s.center_z[i] - o.z();
+            double h   = ( d.x() * ocx ) + ( d.y() * ocy ) + ( d.z() * ocz );
+            double c   = ( ( ocx * ocx ) + ( ocy * ocy ) + ( ocz * ocz ) ) - s.radius_sq[i];
+
+            double discriminant = h*h - a*c;
+            if ( discriminant < 0 ) { continue; }
+
+            double sqrt_d = std::sqrt( discriminant );
+            double root   = ( h - sqrt_d ) / a;
+            if ( ! ( root > ray_t.min && root < best_t ) ) {
+                root = ( h + sqrt_d ) / a;
+                if ( ! ( root > ray_t.min && root < best_t ) ) { continue; }
+            }
+
+            best   = long( i );
+            best_t = root;
+        }
+
+        t = best_t;
+        return best;
+    }
+
+    /*
+     * The vector kernels test every sphere against the full «ray_t» and keep
+     * the smallest root per lane.  A root at or beyond the current closest hit
+     * could never have won in «hit_scalar» either, so the result is the same.
+     * Blocks in which every sphere misses skip the square root and divisions.
+     * Otherwise misses need no explicit mask: a negative discriminant gives a
+     * NaN root, which fails every interval comparison.  Contraction into FMA is off, as
+     * it would round differently from «sphere::hit».
+     */
+#ifdef SPHERE_SOA_X86
+    static long reduce_lanes( const double* lane_t, const double* lane_i, int width, double& t )
+    {
+        long best = -1;
+        t = infinity;
+
+        for ( int k = 0; k < width; ++k ) {
+            if ( lane_t[k] < t || ( lane_t[k] == t && lane_t[k] < infinity && long( lane_i[k] ) < best ) ) {
+                t    = lane_t[k];
+                best = long( lane_i[k] );
+            }
+        }
+
+        return best;
+    }
+
+    __attribute__(( target( "sse2" ), optimize( "fp-contract=off" ) ))
+    static long hit_sse2( const sphere_soa& s, size_t begin, size_t end, const ray& r, interval ray_t, double& t )
+    {
+        const point3& o = r.origin();
+        const vec3&   d = r.direction();
+
+        const __m128d ox = _mm_set1_pd( o.x() ), oy = _mm_set1_pd( o.y() ), oz = _mm_set1_pd( o.z() );
+        const __m128d dx = _mm_set1_pd( d.x() ), dy = _mm_set1_pd( d.y() ), dz = _mm_set1_pd( d.z() );
+        const __m128d a     = _mm_set1_pd( d.length_squared() );
+        const __m128d t_min = _mm_set1_pd( ray_t.min );
+        const __m128d t_max = _mm_set1_pd( ray_t.max );
+        const __m128d inf   = _mm_set1_pd( infinity );
+        const __m128d step  = _mm_set1_pd( 2 );
+        const __m128d zero  = _mm_setzero_pd();
+
+        __m128d best_t = inf;
+        __m128d best_i = _mm_set1_pd( -1 );
+        __m128d index  = _mm_add_pd( _mm_set_pd( 1, 0 ), _mm_set1_pd( double( begin ) ) );
+
+        for ( size_t i = begin; i < end; i += 2 ) {
+            __m128d ocx = _mm_sub_pd( _mm_load_pd( &s.center_x[i] ), ox );
+            __m128d ocy = _mm_sub_pd( _mm_load_pd( &s.center_y[i] ), oy );
+            __m128d ocz = _mm_sub_pd( _mm_load_pd( &s.center_z[i] ), oz );
+
+            __m128d h = _mm_add_pd( _mm_add_pd( _mm_mul_pd( dx, ocx ), _mm_mul_pd( dy, ocy ) ),
+                                    _mm_mul_pd( dz, ocz ) );
+            __m128d c = _mm_sub_pd( _mm_add_pd( _mm_add_pd( _mm_mul_pd( ocx, ocx ), _mm_mul_pd( ocy, ocy ) ),
+                                                _mm_mul_pd( ocz, ocz ) ),
+                                    _mm_load_pd( &s.radius_sq[i] ) );
+
+            __m128d discriminant = _mm_sub_pd( _mm_mul_pd( h, h ), _mm_mul_pd( a, c ) );
+            if ( _mm_movemask_pd( _mm_cmpge_pd( discriminant, zero ) ) == 0 ) {
+                index = _mm_add_pd( index, step );
+                continue;
+            }
+
+            __m128d sqrt_d = _mm_sqrt_pd( discriminant );
+            __m128d root_0 = _mm_div_pd( _mm_sub_pd( h, sqrt_d ), a );
+            __m128d root_1 = _mm_div_pd( _mm_add_pd( h, sqrt_d ), a );
+
+            __m128d in_0 = _mm_and_pd( _mm_cmpgt_pd( root_0, t_min ), _mm_cmplt_pd( root_0, t_max ) );
+            __m128d in_1 = _mm_and_pd( _mm_cmpgt_pd( root_1, t_min ), _mm_cmplt_pd( root_1, t_max ) );
+
+            __m128d root = _mm_or_pd( _mm_and_pd( in_1, root_1 ), _mm_andnot_pd( in_1, inf ) );
+            root = _mm_or_pd( _mm_and_pd( in_0, root_0 ), _mm_andnot_pd( in_0, root ) );
+
+            __m128d closer = _mm_cmplt_pd( root, best_t );
+            best_t = _mm_or_pd( _mm_and_pd( closer, root ),  _mm_andnot_pd( closer, best_t ) );
+            best_i = _mm_or_pd( _mm_and_pd( closer, index ), _mm_andnot_pd( closer, best_i ) );
+            index  = _mm_add_pd( index, step );
+        }
+
+        alignas( 16 ) double lane_t[2], lane_i[2];
+        _mm_store_pd( lane_t, best_t );
+        _mm_store_pd( lane_i, best_i );
+
+        return reduce_lanes( lane_t, lane_i, 2, t );
+    }
+
+    __attribute__(( target( "avx2" ), optimize( "fp-contract=off" ) ))
+    static long hit_avx2( const sphere_soa& s, size_t begin, size_t end, const ray& r, interval ray_t, double& t )
+    {
+        const point3& o = r.origin();
+        const vec3&   d = r.direction();
+
+        const __m256d ox = _mm256_set1_pd( o.x() ), oy = _mm256_set1_pd( o.y() ), oz = _mm256_set1_pd( o.z() );
+        const __m256d dx = _mm256_set1_pd( d.x() ), dy = _mm256_set1_pd( d.y() ), dz = _mm256_set1_pd( d.z() );
+        const __m256d a     = _mm256_set1_pd( d.length_squared() );
+        const __m256d t_min = _mm256_set1_pd( ray_t.min );
+        const __m256d t_max = _mm256_set1_pd( ray_t.max );
+        const __m256d inf   = _mm256_set1_pd( infinity );
+        const __m256d step  = _mm256_set1_pd( 4 );
+        const __m256d zero  = _mm256_setzero_pd();
+
+        __m256d best_t = inf;
+        __m256d best_i = _mm256_set1_pd( -1 );
+        __m256d index  = _mm256_add_pd( _mm256_set_pd( 3, 2, 1, 0 ), _mm256_set1_pd( double( begin ) ) );
+
+        for ( size_t i = begin; i < end; i += 4 ) {
+            __m256d ocx = _mm256_sub_pd( _mm256_load_pd( &s.center_x[i] ), ox );
+            __m256d ocy = _mm256_sub_pd( _mm256_load_pd( &s.center_y[i] ), oy );
+            __m256d ocz = _mm256_sub_pd( _mm256_load_pd( &s.center_z[i] ), oz );
+
+            __m256d h = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( dx, ocx ), _mm256_mul_pd( dy, ocy ) ),
+                                       _mm256_mul_pd( dz, ocz ) );
+            __m256d c = _mm256_sub_pd( _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( ocx, ocx ),
+                                                                     _mm256_mul_pd( ocy, ocy ) ),
+                                                      _mm256_mul_pd( ocz, ocz ) ),
+                                       _mm256_load_pd( &s.radius_sq[i] ) );
+
+            __m256d discriminant = _mm256_sub_pd( _mm256_mul_pd( h, h ), _mm256_mul_pd( a, c ) );
+            if ( _mm256_movemask_pd( _mm256_cmp_pd( discriminant, zero, _CMP_GE_OQ ) ) == 0 ) {
+                index = _mm256_add_pd( index, step );
+                continue;
+            }
+
+            __m256d sqrt_d = _mm256_sqrt_pd( discriminant );
+            __m256d root_0 = _mm256_div_pd( _mm256_sub_pd( h, sqrt_d ), a );
+            __m256d root_1 = _mm256_div_pd( _mm256_add_pd( h, sqrt_d ), a );
+
+            __m256d in_0 = _mm256_and_pd( _mm256_cmp_pd( root_0, t_min, _CMP_GT_OQ ),
+                                          _mm256_cmp_pd( root_0, t_max, _CMP_LT_OQ ) );
+            __m256d in_1 = _mm256_and_pd( _mm256_cmp_pd( root_1, t_min, _CMP_GT_OQ ),
+                                          _mm256_cmp_pd( root_1, t_max, _CMP_LT_OQ ) );
+
+            __m256d root = _mm256_blendv_pd( inf, root_1, in_1 );
+            root = _mm256_blendv_pd( root, root_0, in_0 );
+
+            __m256d closer = _mm256_cmp_pd( root, best_t, _CMP_LT_OQ );
+            best_t = _mm256_blendv_pd( best_t, root, closer );
+            best_i = _mm256_blendv_pd( best_i, index, closer );
+            index  = _mm256_add_pd( index, step );
+        }
+
+        alignas( 32 ) double lane_t[4], lane_i[4];
+        _mm256_store_pd( lane_t, best_t );
+        _mm256_store_pd( lane_i, best_i );
+
+        return reduce_lanes( lane_t, lane_i, 4, t );
+    }
+
+    __attribute__(( target( "avx512f" ), optimize( "fp-contract=off" ) ))
+    static long hit_avx512( const sphere_soa& s, size_t begin, size_t end, const ray& r, interval ray_t, double& t )
+    {
+        const point3& o = r.origin();
+        const vec3&   d = r.direction();
+
+        const __m512d ox = _mm512_set1_pd( o.x() ), oy = _mm512_set1_pd( o.y() ), oz = _mm512_set1_pd( o.z() );
+        const __m512d dx = _mm512_set1_pd( d.x() ), dy = _mm512_set1_pd( d.y() ), dz = _mm512_set1_pd( d.z() );
+        const __m512d a     = _mm512_set1_pd( d.length_squared() );
+        const __m512d t_min = _mm512_set1_pd( ray_t.min );
+        const __m512d t_max = _mm512_set1_pd( ray_t.max );
+        const __m512d inf   = _mm512_set1_pd( infinity );
+        const __m512d step  = _mm512_set1_pd( 8 );
+        const __m512d zero  = _mm512_setzero_pd();
+
+        __m512d best_t = inf;
+        __m512d best_i = _mm512_set1_pd( -1 );
+        __m512d index  = _mm512_add_pd( _mm512_set_pd( 7, 6, 5, 4, 3, 2, 1, 0 ), _mm512_set1_pd( double( begin ) ) );
+
+        for ( size_t i = begin; i < end; i += 8 ) {
+            __m512d ocx = _mm512_sub_pd( _mm512_load_pd( &s.center_x[i] ), ox );
+            __m512d ocy = _mm512_sub_pd( _mm512_load_pd( &s.center_y[i] ), oy );
+            __m512d ocz = _mm512_sub_pd( _mm512_load_pd( &s.center_z[i] ), oz );
+
+            __m512d h = _mm512_add_pd( _mm512_add_pd( _mm512_mul_pd( dx, ocx ), _mm512_mul_pd( dy, ocy ) ),
+                                       _mm512_mul_pd( dz, ocz ) );
+            __m512d c = _mm512_sub_pd( _mm512_add_pd( _mm512_add_pd( _mm512_mul_pd( ocx, ocx ),
+                                                                     _mm512_mul_pd( ocy, ocy ) ),
+                                                      _mm512_mul_pd( ocz, ocz ) ),
+                                       _mm512_load_pd( &s.radius_sq[i] ) );
+
+            __m512d discriminant = _mm512_sub_pd( _mm512_mul_pd( h, h ), _mm512_mul_pd( a, c ) );
+            if ( _mm512_cmp_pd_mask( discriminant, zero, _CMP_GE_OQ ) == 0 ) {
+                index = _mm512_add_pd( index, step );
+                continue;
+            }
+
+            __m512d sqrt_d = _mm512_sqrt_pd( discriminant );
+            __m512d root_0 = _mm512_div_pd( _mm512_sub_pd( h, sqrt_d ), a );
+            __m512d root_1 = _mm512_div_pd( _mm512_add_pd( h, sqrt_d ), a );
+
+            __mmask8 in_0 = _mm512_cmp_pd_mask( root_0, t_min, _CMP_GT_OQ )
+                            & _mm512_cmp_pd_mask( root_0, t_max, _CMP_LT_OQ );
+            __mmask8 in_1 = _mm512_cmp_pd_mask( root_1, t_min, _CMP_GT_OQ )
+                            & _mm512_cmp_pd_mask( root_1, t_max, _CMP_LT_OQ );
+
+            __m512d root = _mm512_mask_blend_pd( in_1, inf, root_1 );
+            root = _mm512_mask_blend_pd( in_0, root, root_0 );
+
+            __mmask8 closer = _mm512_cmp_pd_mask( root, best_t, _CMP_LT_OQ );
+            best_t = _mm512_mask_blend_pd( closer, best_t, root );
+            best_i = _mm512_mask_blend_pd( closer, best_i, index );
+            index  = _mm512_add_pd( index, step );
+        }
+
+        alignas( 64 ) double lane_t[8], lane_i[8];
+        _mm512_store_pd( lane_t, best_t );
+        _mm512_store_pd( lane_i, best_i );
+
+        return reduce_lanes( lane_t, lane_i, 8, t );
+    }
+#endif
+};
+
+/*
+ * Closed-world view of a «linear_bvh» over spheres, with subtrees of up to
+ * «sphere_soa::leaf_width» spheres collapsed into leaves whose spheres are
+ * copied into a block of a «sphere_soa»: a leaf is one vector test instead
+ * of a node test per level and a call per sphere.  Traversal is the
+ * hierarchy's own, over the collapsed copy of its nodes; the hierarchy may
+ * go once this is built.
+ */
+class sphere_soa_bvh
+{
+public:
+    /* Every primitive of «bvh» must be a «sphere» */
+    explicit sphere_soa_bvh( const linear_bvh& bvh )
+    {
+        const linear_bvh_node* source = bvh.node_data();
+        size_t                 count  = bvh.node_count();
+
+        /* Spheres under each node, and the first of them in leaf order */
+        std::vector<std::uint32_t> below( count ), first( count );
+        for ( size_t i = count; i-- > 0; ) {
+            const auto& node = source[i];
+            below[i] = node.count > 0 ? node.count : below[i + 1] + below[node.offset];
+            first[i] = node.count > 0 ? node.offset : first[i + 1];
+        }
+
+        if ( count > 0 ) {
+            nodes.reserve( count );
+            collapse( source, below, first, 0, bvh.leaf_primitives() );
+        }
+
+        view = std::make_unique<linear_bvh>( nodes.data(), nodes.size(), nullptr, bvh.bounding_box() );
+    }
+
+    sphere_soa_bvh( const sphere_soa_bvh& ) = delete;
+    sphere_soa_bvh& operator=( const sphere_soa_bvh& ) = delete;
+
+    bool hit( const ray& r, interval ray_t, hit_record& rec ) const
+    {
+        return view->hit_leaf_nodes( r, ray_t, rec, [this]( const linear_bvh_node& leaf, const ray& r,
+                                                            interval ray_t, hit_record& rec ) {
+            return leaf_hit( leaf, r, ray_t, rec );
+        } );
+    }
+
+    void hit_packet( const ray_packet& packet, interval ray_t, hit_record* recs, bool* hits ) const
+    {
+        view->hit_packet_leaf_nodes( packet, ray_t, recs, hits, [this]( const linear_bvh_node& leaf, const ray& r,
+                                                                        interval ray_t, hit_record& rec ) {
+            return leaf_hit( leaf, r, ray_t, rec );
+        } );
+    }
+
+    size_t sphere_count( void ) const { return spheres.size(); }
+
+    /* Bytes of the sphere blocks and the nodes */
+    size_t footprint( void ) const
+    {
+        return spheres.footprint() + ( nodes.size() * sizeof( linear_bvh_node ) );
+    }
+
+private:
+    sphere_soa                   spheres;
+    std::vector<linear_bvh_node> nodes;
+    std::unique_ptr<linear_bvh>  view;
+
+    /*
+     * Copy the subtree at «index» of «source», making any subtree of at most
+     * «leaf_width» spheres one leaf: its spheres are consecutive in leaf
+     * order.  A leaf of more spheres than that takes consecutive blocks.
+     */
+    void collapse( const linear_bvh_node* source, const std::vector<std::uint32_t>& below,
+                   const std::vector<std::uint32_t>& first, std::uint32_t index,
+                   const hittable* const* primitives )
+    {
+        linear_bvh_node node = source[index];
+        size_t          at   = nodes.size();
+
+        if ( node.count > 0 || below[index] <= sphere_soa::leaf_width ) {
+            std::uint32_t slot = std::uint32_t( spheres.begin_leaf() );
+            for ( std::uint32_t i = 0; i < below[index]; ++i ) {
+                spheres.add( *static_cast<const sphere*>( primitives[first[index] + i] ) );
+            }
+
+            node.offset = slot;
+            node.count  = std::uint16_t( below[index] );
+            nodes.push_back( node );
+            return;
+        }
+
+        nodes.push_back( node );
+        collapse( source, below, first, index + 1, primitives );
+        nodes[at].offset = std::uint32_t( nodes.size() );
+        collapse( source, below, first, node.offset, primitives );
+    }
+
+    bool leaf_hit( const linear_bvh_node& leaf, const ray& r, interval ray_t, hit_record& rec ) const
+    {
+        RTW_STAT( stats::local().sphere_tests += leaf.count );
+
+        bool hit_anything = false;
+        for ( std::uint32_t done = 0; done < leaf.count; done += sphere_soa::leaf_width ) {
+            if ( spheres.hit_leaf( leaf.offset + done, r, ray_t, rec ) ) {
+                hit_anything = true;
+                ray_t.max    = rec.t;
+            }
+        }
+
+        RTW_STAT( if ( hit_anything ) { ++stats::local().sphere_hits; } );
+
+        return hit_anything;
+    }
+};
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*
+ * Render statistics, compiled in with RTW_STATS.  Hot paths bump plain
+ * counters in a per-thread block through «RTW_STAT( ... )», which expands to
+ * nothing otherwise; blocks are only summed when a summary is asked for.
+ */
+
+#ifdef RTW_STATS
+#define RTW_STAT( statement ) statement
+#else
+#define RTW_STAT( statement ) do {} while ( 0 )
+#endif
+
+#include "constants.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct stats_counters
+{
+    /* Bounces past this are counted in the last bucket */
+    static constexpr int max_bounces = 64;
+
+    std::uint64_t rays[max_bounces]         = {};   /* Rays traced, by bounce */
+    std::uint64_t path_lengths[max_bounces] = {};   /* Paths that ended after this many bounces */
+
+    std::uint64_t sphere_tests   = 0;
+    std::uint64_t sphere_hits    = 0;
+    std::uint64_t triangle_tests = 0;
+    std::uint64_t triangle_hits  = 0;
+    std::uint64_t list_tests     = 0;               /* Objects tried by «hittable_list::hit» */
+    std::uint64_t shadow_rays    = 0;               /* Environment samples tested for occlusion */
+
+    /* Scatters by «material::kind» */
+    std::uint64_t scatters[material_kinds::count] = {};
+
+    static int bounce_bucket( int bounce ) { return std::min( bounce, max_bounces - 1 ); }
+
+    void add( const stats_counters& other )
+    {
+        for ( int b = 0; b < max_bounces; ++b ) {
+            rays[b]         += other.rays[b];
+            path_lengths[b] += other.path_lengths[b];
+        }
+        for ( int k = 0; k < material_kinds::count; ++k ) {
+            scatters[k] += other.scatters[k];
+        }
+
+        sphere_tests   += other.sphere_tests;
+        sphere_hits    += other.sphere_hits;
+        triangle_tests += other.triangle_tests;
+        triangle_hits  += other.triangle_hits;
+        list_tests     += other.list_tests;
+        shadow_rays    += other.shadow_rays;
+    }
+};
+
+class stats
+{
+public:
+    /* The calling thread's counters */
+    static stats_counters& local( void ) { return block().counters; }
+
+    /*
+     * Sum over every thread.  Only meaningful while no other thread is
+     * counting, e.g. between two «thread_pool::parallel_for» calls.
+     */
+    static stats_counters collect( void )
+    {
+        std::lock_guard<std::mutex> guard( registry().lock );
+
+        stats_counters total = registry().retired;
+        for ( auto* counters : registry().live ) {
+            total.add( *counters );
+        }
+
+        return total;
+    }
+
+    static void reset( void )
+    {
+        std::lock_guard<std::mutex> guard( registry().lock );
+
+        registry().retired = stats_counters();
+        for ( auto* counters : registry().live ) {
+            *counters = stats_counters();
+        }
+        registry().phases.clear();
+    }
+
+    /* Close the current wall-time phase, if any, and open «name» */
+    static void begin_phase( const char* name )
+    {
+        end_phase();
+        registry().phase_name  = name;
+        registry().phase_start = std::chrono::steady_clock::now();
+    }
+
+    static void end_phase( void )
+    {
+        auto& r = registry();
+        if ( r.phase_name == nullptr ) { return; }
+
+        double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - r.phase_start ).count();
+        r.phases.emplace_back( r.phase_name, seconds );
+        r.phase_name = nullptr;
+    }
+
+    static void report( std::ostream& out )
+    {
+        end_phase();
+        stats_counters total = collect();
+
+        std::uint64_t rays = 0, paths = 0;
+        for ( int b = 0; b < stats_counters::max_bounces; ++b ) {
+            rays  += total.rays[b];
+            paths += total.path_lengths[b];
+        }
+
+        auto ratio = []( std::uint64_t a, std::uint64_t b ) { return b > 0 ? double( a ) / b : 0.0; };
+
+        out << "Statistics:\n"
+            << "  Rays traced          " << rays << "\n"
+            << "  Sphere tests         " << total.sphere_tests
+            << " (" << ratio( total.sphere_tests, rays ) << " per ray)\n"
+            << "  Sphere hits          " << total.sphere_hits
+            << " (" << 100 * ratio( total.sphere_hits, total.sphere_tests ) << "% of tests)\n"
+            << "  Triangle tests       " << total.triangle_tests
+            << " (" << ratio( total.triangle_tests, rays ) << " per ray)\n"
+            << "  Triangle hits        " << total.triangle_hits
+            << " (" << 100 * ratio( total.triangle_hits, total.triangle_tests ) << "% of tests)\n"
+            << "  List object tests    " << total.list_tests << "\n"
+            << "  Shadow rays          " << total.shadow_rays << "\n"
+            << "  Scatters             lambertian " << total.scatters[material_kinds::lambertian]
+            << ", metal " << total.scatters[material_kinds::metal]
+            << ", dielectric " << total.scatters[material_kinds::dielectric]
+            << ", other " << total.scatters[material_kinds::other] << "\n";
+
+        out << "  Rays by bounce      ";
+        for ( int b = 0; b < stats_counters::max_bounces; ++b ) {
+            if ( total.rays[b] > 0 ) { out << ' ' << b << ':' << total.rays[b]; }
+        }
+
+        out << "\n  Path lengths        ";
+        for ( int b = 0; b < stats_counters::max_bounces; ++b ) {
+            if ( total.path_lengths[b] > 0 ) {
+                out << ' ' << b << ':' << std::fixed << std::setprecision( 1 )
+                    << 100 * ratio( total.path_lengths[b], paths ) << '%' << std::defaultfloat;
+            }
+        }
+        out << "\n";
+
+        for ( const auto& phase : registry().phases ) {
+            out << "  Phase " << std::left << std::setw( 15 ) << phase.first << std::right
+                << phase.second << " s\n";
+        }
+    }
+
+private:
+    struct shared
+    {
+        std::mutex                   lock;
+        std::vector<stats_counters*> live;
+        stats_counters               retired;      /* Counts of threads that have exited */
+
+        /* Wall-time phases, only touched by the thread driving the render */
+        std::vector<std::pair<std::string, double>> phases;
+        const char*                                 phase_name = nullptr;
+        std::chrono::steady_clock::time_point       phase_start;
+    };
+
+    /* A thread's counters, registered for as long as the thread runs */
+    struct thread_block
+    {
+        stats_counters counters;
+
+        thread_block()
+        {
+            std::lock_guard<std::mutex> guard( registry().lock );
+            registry().live.push_back( &counters );
+        }
+
+        ~thread_block()
+        {
+            std::lock_guard<std::mutex> guard( registry().lock );
+            auto& live = registry().live;
+            live.erase( std::find( live.begin(), live.end(), &counters ) );
+            registry().retired.add( counters );
+        }
+    };
+
+    static shared& registry( void )
+    {
+        static shared r;
+        return r;
+    }
+
+    static thread_block& block( void )
+    {
+        static thread_local thread_block b;
+        return b;
+    }
+};
+
+#endif
@@ -1,2 +1,10 @@
+#ifndef STB_INCLUDE_H
+#define STB_INCLUDE_H
+
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "external/stb_image_write.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "external/stb_image.h"
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed-size pool of worker threads with one task deque per worker.
+ *
+ * «parallel_for» deals contiguous blocks of indices to the workers; a worker
+ * pops from the back of its own deque and, once it runs dry, steals from the
+ * front of the other deques.  The calling thread takes part as worker 0.
+ */
+class thread_pool
+{
+public:
+    /* A «thread_count» of 0 picks the hardware concurrency */
+    explicit thread_pool( unsigned thread_count = 0 )
+    {
+        if ( thread_count == 0 ) {
+            thread_count = std::max( 1u, std::thread::hardware_concurrency() );
+        }
+
+        for ( unsigned i = 0; i < thread_count; ++i ) {
+            queues.push_back( std::make_unique<task_queue>() );
+        }
+
+        for ( unsigned i = 1; i < thread_count; ++i ) {
+            workers.emplace_back( [this, i] { worker_loop( i ); } );
+        }
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> guard( lock );
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for ( auto& worker : workers ) {
+            worker.join();
+        }
+    }
+
+    thread_pool( const thread_pool& )            = delete;
+    thread_pool& operator =( const thread_pool& ) = delete;
+
+    unsigned size() const { return unsigned( queues.size() ); }
+
+    /*
+     * Call «body( i )» for every «i» in [0, «count») and return once all
+     * calls have finished.  Not reentrant.
+     */
+    void parallel_for( size_t count, const std::function<void( size_t )>& body )
+    {
+        if ( count == 0 ) { return; }
+
+        /*
+         * The job and its tasks appear together: a worker still waking from
+         * an earlier call can only pop tasks whose job is already set.
+         */
+        {
+            std::lock_guard<std::mutex> guard( lock );
+            job.store( &body, std::memory_order_release );
+            pending = count;
+            ++generation;
+
+            size_t per_queue = ( count + queues.size() - 1 ) / queues.size();
+            for ( size_t q = 0; q < queues.size(); ++q ) {
+                std::lock_guard<std::mutex> queue_guard( queues[q]->lock );
+                for ( size_t i = q * per_queue; i < std::min( count, ( q + 1 ) * per_queue ); ++i ) {
+                    queues[q]->tasks.push_back( i );
+                }
+            }
+        }
+        wake.notify_all();
+
+        run_tasks( 0 );
+
+        std::unique_lock<std::mutex> guard( lock );
+        done.wait( guard, [this] { return pending == 0 && active == 0; } );
+        job.store( nullptr, std::memory_order_relaxed );
+    }
+
+private:
+    struct task_queue
+    {
+        std::mutex         lock;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<std::unique_ptr<task_queue>> queues;
+    std::vector<std::thread>                 workers;
+
+    std::mutex              lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    /* Only cleared once every task has run, so it is set for any task a worker pops */
+    std::atomic<const std::function<void( size_t )>*> job { nullptr };
+
+    size_t   pending    = 0;
+    unsigned active     = 0;
+    unsigned generation = 0;
+    bool     stopping   = false;
+
+    void worker_loop( unsigned self )
+    {
+        unsigned seen = 0;
+
+        while ( true ) {
+            {
+                std::unique_lock<std::mutex> guard( lock );
+                wake.wait( guard, [&] { return stopping || generation != seen; } );
+                if ( stopping ) { return; }
+
+                seen = generation;
+                ++active;
+            }
+
+            run_tasks( self );
+
+            {
+                std::lock_guard<std::mutex> guard( lock );
+                --active;
+            }
+            done.notify_all();
+        }
+    }
+
+    void run_tasks( unsigned self )
+    {
+        size_t index;
+
+        while ( pop( self, index ) || steal( self, index ) ) {
+            ( *job.load( std::memory_order_acquire ) )( index );
+
+            std::lock_guard<std::mutex> guard( lock );
+            if ( --pending == 0 ) {
+                done.notify_all();
+            }
+        }
+    }
+
+    bool pop( unsigned self, size_t& index )
+    {
+        auto& queue = *queues[self];
+        std::lock_guard<std::mutex> guard( queue.lock );
+
+        if ( queue.tasks.empty() ) { return false; }
+
+        index = queue.tasks.back();
+        queue.tasks.pop_back();
+
+        return true;
+    }
+
+    bool steal( unsigned self, size_t& index )
+    {
+        for ( size_t k = 1; k < queues.size(); ++k ) {
+            auto& victim = *queues[( self + k ) % queues.size()];
+            std::lock_guard<std::mutex> guard( victim.lock );
+
+            if ( ! victim.tasks.empty() ) {
+                index = victim.tasks.front();
+                victim.tasks.pop_front();
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+#endif
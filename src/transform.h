@@ -0,0 +1,189 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "ray.h"
+#include "vec3.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/*
+ * Affine map x ↦ M x + t, kept together with its inverse: transforms are
+ * only ever built from translations, rotations and scalings, whose inverses
+ * are known, and composed, so nothing is inverted numerically.
+ */
+class transform
+{
+public:
+    /* The identity */
+    transform() : transform( identity_matrix(), vec3(), identity_matrix(), vec3() ) {}
+
+    static transform translate( const vec3& offset )
+    {
+        return transform( identity_matrix(), offset, identity_matrix(), -offset );
+    }
+
+    static transform scale( real factor )
+    {
+        return scale( vec3( factor, factor, factor ) );
+    }
+
+    static transform scale( const vec3& factors )
+    {
+        matrix m = {}, inverse = {};
+        for ( int i = 0; i < 3; ++i ) {
+            m.e[i][i]       = factors[i];
+            inverse.e[i][i] = 1 / factors[i];
+        }
+
+        return transform( m, vec3(), inverse, vec3() );
+    }
+
+    /* Rotation by «degrees» about «axis», counterclockwise looking down the axis */
+    static transform rotate( const vec3& axis, double degrees )
+    {
+        vec3 a = unit_vector( axis );
+        real s = real( std::sin( degrees_to_radians( degrees ) ) );
+        real c = real( std::cos( degrees_to_radians( degrees ) ) );
+
+        /* Rodrigues' formula; the inverse of a rotation is its transpose */
+        matrix m, inverse;
+        for ( int i = 0; i < 3; ++i ) {
+            for ( int j = 0; j < 3; ++j ) {
+                m.e[i][j] = ( a[i] * a[j] * ( 1 - c ) ) + ( i == j ? c : 0 );
+            }
+        }
+        m.e[0][1] -= a[2] * s;  m.e[1][0] += a[2] * s;
+        m.e[0][2] += a[1] * s;  m.e[2][0] -= a[1] * s;
+        m.e[1][2] -= a[0] * s;  m.e[2][1] += a[0] * s;
+
+        for ( int i = 0; i < 3; ++i ) {
+            for ( int j = 0; j < 3; ++j ) {
+                inverse.e[i][j] = m.e[j][i];
+            }
+        }
+
+        return transform( m, vec3(), inverse, vec3() );
+    }
+
+    /* «this» after «first»: ( a * b )( x ) = a( b( x ) ) */
+    transform operator *( const transform& first ) const
+    {
+        return transform( multiply( m, first.m ), apply( m, first.t ) + t,
+                          multiply( first.inv_m, inv_m ), apply( first.inv_m, inv_t ) + first.inv_t );
+    }
+
+    transform inverse( void ) const
+    {
+        return transform( inv_m, inv_t, m, t );
+    }
+
+    point3 point( const point3& p ) const { return apply( m, p ) + t; }
+    vec3   vector( const vec3& v ) const  { return apply( m, v ); }
+
+    /* Normals go by the inverse transpose, which keeps them perpendicular to the surface */
+    vec3 normal( const vec3& n ) const
+    {
+        const auto& a = inv_m.e;
+
+        return vec3( ( a[0][0] * n[0] ) + ( a[1][0] * n[1] ) + ( a[2][0] * n[2] ),
+                     ( a[0][1] * n[0] ) + ( a[1][1] * n[1] ) + ( a[2][1] * n[2] ),
+                     ( a[0][2] * n[0] ) + ( a[1][2] * n[1] ) + ( a[2][2] * n[2] ) );
+    }
+
+    /*
+     * «r» taken through the inverse.  The direction is not renormalized, so
+     * distances along the ray, its t values, are the same on both sides.
+     */
+    ray to_local( const ray& r ) const
+    {
+        return ray( apply( inv_m, r.origin() ) + inv_t, apply( inv_m, r.direction() ) );
+    }
+
+    /* Box around the image of «box», from its eight corners */
+    aabb box( const aabb& box ) const
+    {
+        aabb result;
+        for ( int corner = 0; corner < 8; ++corner ) {
+            point3 q = point( point3( ( corner & 1 ) ? box.x.max : box.x.min,
+                                      ( corner & 2 ) ? box.y.max : box.y.min,
+                                      ( corner & 4 ) ? box.z.max : box.z.min ) );
+            result   = aabb( result, aabb( q, q ) );
+        }
+
+        return result;
+    }
+
+    /* Largest factor by which the map can grow an error in any coordinate */
+    real gain( void ) const
+    {
+        real norm = 0;
+        for ( const auto& row : m.e ) {
+            norm = std::max( norm, std::fabs( row[0] ) + std::fabs( row[1] ) + std::fabs( row[2] ) );
+        }
+
+        return norm;
+    }
+
+    /*
+     * Bounds on the rounding error of each coordinate of «point( p )», and of
+     * «to_local» on a world-space point «p»: a few roundings of the largest
+     * magnitude summed.
+     */
+    real point_error( const point3& p ) const       { return rounding_error( m, t, p ); }
+    real local_point_error( const point3& p ) const { return rounding_error( inv_m, inv_t, p ); }
+
+private:
+    struct matrix
+    {
+        real e[3][3];
+    };
+
+    matrix m, inv_m;
+    vec3   t, inv_t;
+
+    transform( const matrix& m, const vec3& t, const matrix& inv_m, const vec3& inv_t )
+        : m( m ), inv_m( inv_m ), t( t ), inv_t( inv_t )
+    {}
+
+    static matrix identity_matrix( void )
+    {
+        return { { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } } };
+    }
+
+    static matrix multiply( const matrix& a, const matrix& b )
+    {
+        matrix product;
+        for ( int i = 0; i < 3; ++i ) {
+            for ( int j = 0; j < 3; ++j ) {
+                product.e[i][j] = ( a.e[i][0] * b.e[0][j] ) + ( a.e[i][1] * b.e[1][j] ) + ( a.e[i][2] * b.e[2][j] );
+            }
+        }
+
+        return product;
+    }
+
+    static vec3 apply( const matrix& a, const vec3& v )
+    {
+        return vec3( ( a.e[0][0] * v[0] ) + ( a.e[0][1] * v[1] ) + ( a.e[0][2] * v[2] ),
+                     ( a.e[1][0] * v[0] ) + ( a.e[1][1] * v[1] ) + ( a.e[1][2] * v[2] ),
+                     ( a.e[2][0] * v[0] ) + ( a.e[2][1] * v[1] ) + ( a.e[2][2] * v[2] ) );
+    }
+
+    static real rounding_error( const matrix& a, const vec3& offset, const point3& p )
+    {
+        real largest = 0;
+        for ( int i = 0; i < 3; ++i ) {
+            real sum = std::fabs( a.e[i][0] * p[0] ) + std::fabs( a.e[i][1] * p[1] ) + std::fabs( a.e[i][2] * p[2] )
+                       + std::fabs( offset[i] );
+            largest  = std::max( largest, sum );
+        }
+
+        return 4 * std::numeric_limits<real>::epsilon() * largest;
+    }
+};
+
+#endif
@@ -0,0 +1,490 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "hittable.h"
+#include "vec3.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+/*
+ * Vertex and index buffers of a triangle mesh: three floats per vertex and
+ * three vertex indices per triangle, so triangles share their vertices.
+ */
+struct mesh_buffers
+{
+    std::vector<float>         positions;
+    std::vector<std::uint32_t> indices;
+
+    size_t vertex_count( void ) const   { return positions.size() / 3; }
+    size_t triangle_count( void ) const { return indices.size() / 3; }
+};
+
+/*
+ * Node of a «triangle_mesh» hierarchy, half the size of a «linear_bvh_node»:
+ * bounds are 16-bit coordinates on a grid over the mesh's bounding box,
+ * rounded outwards, and the rest packs into one word.  Nodes are stored
+ * depth-first like those of «linear_bvh».
+ */
+struct quantized_bvh_node
+{
+    std::uint16_t lo[3];
+    std::uint16_t hi[3];
+
+    /*
+     * Leaf: bit 31 set, bits 28-30 the triangle count less one, bits 0-27
+     * the first triangle.  Interior node: bits 29-30 the split axis, bits
+     * 0-28 the second child.
+     */
+    std::uint32_t link;
+
+    static constexpr std::uint32_t leaf_flag      = 1U << 31;
+    static constexpr std::uint32_t max_triangles  = 1U << 28;
+    static constexpr std::uint32_t max_nodes      = 1U << 29;    /* Over twice «max_triangles» */
+    static constexpr std::uint32_t max_leaf_count = 8;
+
+    bool          is_leaf( void ) const { return ( link & leaf_flag ) != 0; }
+    std::uint32_t first( void ) const   { return link & ( max_triangles - 1 ); }
+    std::uint32_t count( void ) const   { return ( ( link >> 28 ) & 7 ) + 1; }
+    std::uint32_t second( void ) const  { return link & ( max_nodes - 1 ); }
+    int           axis( void ) const    { return int( ( link >> 29 ) & 3 ); }
+};
+
+static_assert( sizeof( quantized_bvh_node ) == 16, "quantized_bvh_node must stay 16 bytes" );
+
+/*
+ * Triangle mesh with one material and its own hierarchy.  Ray-triangle
+ * tests are watertight (Woop, Benthin and Wald, "Watertight Ray/Triangle
+ * Intersection", 2013): a ray through an edge or vertex shared by two
+ * triangles hits at least one of them, so there are no cracks to leak
+ * through.  Building reorders the triangles into leaf order.
+ */
+class triangle_mesh : public hittable
+{
+public:
+    triangle_mesh( mesh_buffers buffers, const material* mat )
+        : buffers( std::move( buffers ) ), mat( mat )
+    {
+        if ( this->buffers.triangle_count() >= quantized_bvh_node::max_triangles ) {
+            std::cerr << "Mesh of " << this->buffers.triangle_count() << " triangles is too large" << std::endl;
+            this->buffers.indices.clear();
+        }
+
+        build();
+    }
+
+    bool hit( const ray& r, interval ray_t, hit_record& rec ) const override
+    {
+        if ( nodes.empty() ) { return false; }
+
+        const point3& orig = r.origin();
+        const vec3&   dir  = r.direction();
+
+        /* Slab tests run on the grid: the ray's origin and inverse direction in grid units */
+        real orig_q[3], inv_q[3];
+        bool dir_is_neg[3];
+        for ( int a = 0; a < 3; ++a ) {
+            orig_q[a]     = ( orig[a] - grid_origin[a] ) / grid_scale[a];
+            inv_q[a]      = grid_scale[a] / dir[a];
+            dir_is_neg[a] = inv_q[a] < 0;
+        }
+
+        /* Watertight test: permute the axes so z is the ray's largest, then shear along it */
+        int kz = 0;
+        for ( int a = 1; a < 3; ++a ) {
+            if ( std::fabs( dir[a] ) > std::fabs( dir[kz] ) ) { kz = a; }
+        }
+        int kx = ( kz + 1 ) % 3, ky = ( kx + 1 ) % 3;
+        if ( dir[kz] < 0 ) { std::swap( kx, ky ); }
+
+        shear s;
+        s.kx = kx;  s.ky = ky;  s.kz = kz;
+        s.sx = dir[kx] / dir[kz];
+        s.sy = dir[ky] / dir[kz];
+        s.sz = 1 / dir[kz];
+
+        std::uint32_t stack[max_depth];
+        int           top          = 0;
+        std::uint32_t current      = 0;
+        bool          hit_anything = false;
+
+        while ( true ) {
+            const quantized_bvh_node& node = nodes[current];
+
+            if ( node_hit( node, orig_q, inv_q, ray_t ) ) {
+                if ( node.is_leaf() ) {
+                    for ( std::uint32_t i = node.first(); i < node.first() + node.count(); ++i ) {
+                        if ( triangle_hit( i, r, s, ray_t, rec ) ) {
+                            hit_anything = true;
+                            ray_t.max    = rec.t;
+                        }
+                    }
+
+                    if ( top == 0 ) { break; }
+                    current = stack[--top];
+                } else if ( dir_is_neg[node.axis()] ) {
+                    stack[top++] = current + 1;
+                    current      = node.second();
+                } else {
+                    stack[top++] = node.second();
+                    current      = current + 1;
+                }
+            } else {
+                if ( top == 0 ) { break; }
+                current = stack[--top];
+            }
+        }
+
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t triangle_count( void ) const { return buffers.triangle_count(); }
+    size_t vertex_count( void ) const   { return buffers.vertex_count(); }
+    size_t node_count( void ) const     { return nodes.size(); }
+
+    /* Bytes of the buffers and the hierarchy */
+    size_t footprint( void ) const
+    {
+        return ( buffers.positions.size() * sizeof( float ) ) + ( buffers.indices.size() * sizeof( std::uint32_t ) )
+               + ( nodes.size() * sizeof( quantized_bvh_node ) );
+    }
+
+private:
+    mesh_buffers                    buffers;
+    const material*                 mat;
+    std::vector<quantized_bvh_node> nodes;
+    aabb                            bbox;
+    real                            grid_origin[3] = { 0, 0, 0 };
+    real                            grid_scale[3]  = { 1, 1, 1 };
+
+    /* Per-ray constants of the watertight test */
+    struct shear
+    {
+        int  kx, ky, kz;
+        real sx, sy, sz;
+    };
+
+    static constexpr int    max_depth   = 64;
+    static constexpr int    sah_depth   = 32;       /* Deeper subtrees split at the median */
+    static constexpr int    bin_count   = 16;
+    static constexpr size_t leaf_target = 4;        /* Fewest triangles worth splitting further */
+
+    static constexpr real grid_cells = 65535;
+
+    static bool node_hit( const quantized_bvh_node& node, const real* orig_q, const real* inv_q, interval ray_t )
+    {
+        for ( int a = 0; a < 3; ++a ) {
+            real t0 = ( real( node.lo[a] ) - orig_q[a] ) * inv_q[a];
+            real t1 = ( real( node.hi[a] ) - orig_q[a] ) * inv_q[a];
+            if ( t0 > t1 ) { std::swap( t0, t1 ); }
+
+            ray_t.min = t0 > ray_t.min ? t0 : ray_t.min;
+            ray_t.max = t1 < ray_t.max ? t1 : ray_t.max;
+
+            /* A touch counts: a slab one cell thick may be thinner than the ray's rounding */
+            if ( ray_t.max < ray_t.min ) { return false; }
+        }
+
+        return true;
+    }
+
+    point3 vertex( std::uint32_t index ) const
+    {
+        const float* p = &buffers.positions[3 * size_t( index )];
+        return point3( real( p[0] ), real( p[1] ), real( p[2] ) );
+    }
+
+    bool triangle_hit( std::uint32_t triangle, const ray& r, const shear& s, interval ray_t, hit_record& rec ) const
+    {
+        RTW_STAT( ++stats::local().triangle_tests );
+
+        const std::uint32_t* corner = &buffers.indices[3 * size_t( triangle )];
+        point3 p0 = vertex( corner[0] ), p1 = vertex( corner[1] ), p2 = vertex( corner[2] );
+
+        /* Vertices relative to the ray origin, sheared so that the ray runs along +z */
+        vec3 a = p0 - r.origin(), b = p1 - r.origin(), c = p2 - r.origin();
+
+        real ax = a[s.kx] - ( s.sx * a[s.kz] ), ay = a[s.ky] - ( s.sy * a[s.kz] );
+        real bx = b[s.kx] - ( s.sx * b[s.kz] ), by = b[s.ky] - ( s.sy * b[s.kz] );
+        real cx = c[s.kx] - ( s.sx * c[s.kz] ), cy = c[s.ky] - ( s.sy * c[s.kz] );
+
+        /* Scaled barycentrics: edge functions of the projected triangle at the origin */
+        real u = ( cx * by ) - ( cy * bx );
+        real v = ( ax * cy ) - ( ay * cx );
+        real w = ( bx * ay ) - ( by * ax );
+
+        /* On an edge, redo the edge functions in double precision, so that exactly 0 means on it */
+        if ( sizeof( real ) < sizeof( double ) && ( u == 0 || v == 0 || w == 0 ) ) {
+            u = real( ( double( cx ) * double( by ) ) - ( double( cy ) * double( bx ) ) );
+            v = real( ( double( ax ) * double( cy ) ) - ( double( ay ) * double( cx ) ) );
+            w = real( ( double( bx ) * double( ay ) ) - ( double( by ) * double( ax ) ) );
+        }
+
+        if ( ( u < 0 || v < 0 || w < 0 ) && ( u > 0 || v > 0 || w > 0 ) ) { return false; }
+
+        real det = u + v + w;
+        if ( det == 0 ) { return false; }
+
+        real t_scaled = ( u * s.sz * a[s.kz] ) + ( v * s.sz * b[s.kz] ) + ( w * s.sz * c[s.kz] );
+        real t        = t_scaled / det;
+        if ( ! ray_t.surrounds( t ) ) { return false; }
+
+        real b0 = u / det, b1 = v / det, b2 = w / det;
+
+        /* The hit point from the barycentrics, with its error bound */
+        vec3 p = ( b0 * p0 ) + ( b1 * p1 ) + ( b2 * p2 );
+        vec3 extent( std::fabs( b0 * p0.x() ) + std::fabs( b1 * p1.x() ) + std::fabs( b2 * p2.x() ),
+                     std::fabs( b0 * p0.y() ) + std::fabs( b1 * p1.y() ) + std::fabs( b2 * p2.y() ),
+                     std::fabs( b0 * p0.z() ) + std::fabs( b1 * p1.z() ) + std::fabs( b2 * p2.z() ) );
+
+        rec.t       = t;
+        rec.p       = p;
+        rec.p_error = 8 * std::numeric_limits<real>::epsilon() * std::max( { extent.x(), extent.y(), extent.z() } );
+        rec.set_face_normal( r, unit_vector( cross( p1 - p0, p2 - p0 ) ) );
+        rec.mat     = mat;
+
+        RTW_STAT( ++stats::local().triangle_hits );
+
+        return true;
+    }
+
+    /* Bounds of one triangle during the build, in floats to keep the build small */
+    struct build_box
+    {
+        float lo[3], hi[3];
+
+        float centroid( int axis ) const { return 0.5f * ( lo[axis] + hi[axis] ); }
+
+        void grow( const build_box& other )
+        {
+            for ( int a = 0; a < 3; ++a ) {
+                lo[a] = std::min( lo[a], other.lo[a] );
+                hi[a] = std::max( hi[a], other.hi[a] );
+            }
+        }
+
+        float half_area( void ) const
+        {
+            float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+            return ( dx * dy ) + ( dy * dz ) + ( dz * dx );
+        }
+
+        static build_box empty( void )
+        {
+            constexpr float big = std::numeric_limits<float>::max();
+            return { { big, big, big }, { -big, -big, -big } };
+        }
+    };
+
+    /*
+     * Binned SAH build straight into quantized nodes.  The build keeps a
+     * float box per triangle and a permutation, 28 bytes per triangle, and
+     * no pointer tree; the index buffer is reordered into leaf order at the
+     * end.
+     */
+    void build( void )
+    {
+        size_t count = buffers.triangle_count();
+        if ( count == 0 ) { return; }
+
+        std::vector<build_box> boxes( count );
+        build_box              bounds = build_box::empty();
+        for ( size_t i = 0; i < count; ++i ) {
+            build_box box = build_box::empty();
+            for ( int k = 0; k < 3; ++k ) {
+                const float* p = &buffers.positions[3 * size_t( buffers.indices[( 3 * i ) + k] )];
+                for ( int a = 0; a < 3; ++a ) {
+                    box.lo[a] = std::min( box.lo[a], p[a] );
+                    box.hi[a] = std::max( box.hi[a], p[a] );
+                }
+            }
+            boxes[i] = box;
+            bounds.grow( box );
+        }
+
+        /*
+         * The grid spans the bounds, a little enlarged so that rounding cannot
+         * push a box past its last cell; a flat axis gets a sliver of the
+         * largest extent so that its cells are not vanishingly small.
+         */
+        real largest = 0;
+        for ( int a = 0; a < 3; ++a ) {
+            largest = std::max( largest, real( bounds.hi[a] ) - real( bounds.lo[a] ) );
+        }
+        largest = std::max( largest, real( 1e-20 ) );
+        for ( int a = 0; a < 3; ++a ) {
+            real extent    = std::max( real( bounds.hi[a] ) - real( bounds.lo[a] ), largest * real( 1e-4 ) );
+            grid_origin[a] = real( bounds.lo[a] );
+            grid_scale[a]  = extent * real( 1 + 1e-5 ) / grid_cells;
+        }
+        bbox = aabb( point3( real( bounds.lo[0] ), real( bounds.lo[1] ), real( bounds.lo[2] ) ),
+                     point3( real( bounds.hi[0] ), real( bounds.hi[1] ), real( bounds.hi[2] ) ) );
+
+        std::vector<std::uint32_t> order( count );
+        std::iota( order.begin(), order.end(), 0U );
+
+        nodes.reserve( ( 2 * count ) / leaf_target );
+        build_range( boxes, order, 0, count, 0 );
+        nodes.shrink_to_fit();
+
+        /* Free the boxes before the reordered copy of the indices is made */
+        boxes = std::vector<build_box>();
+
+        std::vector<std::uint32_t> ordered( buffers.indices.size() );
+        for ( size_t i = 0; i < count; ++i ) {
+            std::copy_n( &buffers.indices[3 * size_t( order[i] )], 3, &ordered[3 * i] );
+        }
+        buffers.indices = std::move( ordered );
+    }
+
+    void build_range( const std::vector<build_box>& boxes, std::vector<std::uint32_t>& order,
+                      size_t begin, size_t end, int depth )
+    {
+        build_box bounds   = build_box::empty();
+        build_box centroid = build_box::empty();
+        for ( size_t i = begin; i < end; ++i ) {
+            const build_box& box = boxes[order[i]];
+            bounds.grow( box );
+            for ( int a = 0; a < 3; ++a ) {
+                float c = box.centroid( a );
+                centroid.lo[a] = std::min( centroid.lo[a], c );
+                centroid.hi[a] = std::max( centroid.hi[a], c );
+            }
+        }
+
+        size_t index = nodes.size();
+        nodes.push_back( quantize( bounds ) );
+
+        size_t count = end - begin;
+        int    axis  = 0;
+        for ( int a = 1; a < 3; ++a ) {
+            if ( centroid.hi[a] - centroid.lo[a] > centroid.hi[axis] - centroid.lo[axis] ) { axis = a; }
+        }
+
+        bool   flat   = centroid.hi[axis] <= centroid.lo[axis];
+        size_t split  = begin + ( count / 2 );
+        bool   median = true;
+
+        if ( count <= leaf_target || ( flat && count <= quantized_bvh_node::max_leaf_count ) ) {
+            make_leaf( index, begin, count );
+            return;
+        }
+
+        if ( ! flat && depth < sah_depth ) {
+            /* Cheapest of the bin boundaries on the widest centroid axis, against a leaf */
+            struct bin
+            {
+                build_box box   = build_box::empty();
+                size_t    count = 0;
+            };
+            bin   bins[bin_count];
+            float to_bin = bin_count / ( centroid.hi[axis] - centroid.lo[axis] );
+
+            auto bin_of = [&]( std::uint32_t triangle ) {
+                int b = int( ( boxes[triangle].centroid( axis ) - centroid.lo[axis] ) * to_bin );
+                return std::min( b, bin_count - 1 );
+            };
+
+            for ( size_t i = begin; i < end; ++i ) {
+                bin& b = bins[bin_of( order[i] )];
+                b.box.grow( boxes[order[i]] );
+                ++b.count;
+            }
+
+            float  right_area[bin_count];
+            size_t right_count[bin_count];
+            build_box right = build_box::empty();
+            size_t    right_total = 0;
+            for ( int b = bin_count - 1; b > 0; --b ) {
+                right.grow( bins[b].box );
+                right_total   += bins[b].count;
+                right_area[b]  = right_total > 0 ? right.half_area() : 0;
+                right_count[b] = right_total;
+            }
+
+            float     best_cost = std::numeric_limits<float>::max();
+            int       best_bin  = -1;
+            build_box left      = build_box::empty();
+            size_t    left_total = 0;
+            for ( int b = 1; b < bin_count; ++b ) {
+                left.grow( bins[b - 1].box );
+                left_total += bins[b - 1].count;
+                if ( left_total == 0 || right_count[b] == 0 ) { continue; }
+
+                float cost = ( left.half_area() * float( left_total ) ) + ( right_area[b] * float( right_count[b] ) );
+                if ( cost < best_cost ) {
+                    best_cost = cost;
+                    best_bin  = b;
+                }
+            }
+
+            /* Splitting costs a traversal step and its children's tests; a leaf costs its own tests */
+            float leaf_cost = bounds.half_area() * float( count );
+            if ( count <= quantized_bvh_node::max_leaf_count && ( best_bin < 0 || best_cost + bounds.half_area() >= leaf_cost ) ) {
+                make_leaf( index, begin, count );
+                return;
+            }
+
+            if ( best_bin >= 0 ) {
+                split  = size_t( std::partition( order.begin() + begin, order.begin() + end,
+                                                 [&]( std::uint32_t t ) { return bin_of( t ) < best_bin; } )
+                                 - order.begin() );
+                median = false;
+            }
+        }
+
+        if ( median ) {
+            std::nth_element( order.begin() + begin, order.begin() + split, order.begin() + end,
+                              [&]( std::uint32_t l, std::uint32_t r ) {
+                                  return boxes[l].centroid( axis ) < boxes[r].centroid( axis );
+                              } );
+        }
+
+        build_range( boxes, order, begin, split, depth + 1 );
+
+        nodes[index].link = std::uint32_t( nodes.size() ) | ( std::uint32_t( axis ) << 29 );
+
+        build_range( boxes, order, split, end, depth + 1 );
+    }
+
+    void make_leaf( size_t index, size_t begin, size_t count )
+    {
+        nodes[index].link = quantized_bvh_node::leaf_flag | ( std::uint32_t( count - 1 ) << 28 ) | std::uint32_t( begin );
+    }
+
+    /*
+     * «box» on the grid, rounded outwards and at least a cell thick, so that
+     * a box flat on a grid line, such as a plane's, still has a slab to enter.
+     */
+    quantized_bvh_node quantize( const build_box& box ) const
+    {
+        quantized_bvh_node node = {};
+        for ( int a = 0; a < 3; ++a ) {
+            double lo = std::floor( ( double( box.lo[a] ) - grid_origin[a] ) / grid_scale[a] );
+            double hi = std::ceil( ( double( box.hi[a] ) - grid_origin[a] ) / grid_scale[a] );
+            lo = std::clamp( lo, 0.0, double( grid_cells ) );
+            hi = std::clamp( hi, 0.0, double( grid_cells ) );
+            if ( hi <= lo ) {
+                if ( lo < grid_cells ) { hi = lo + 1; } else { lo = hi - 1; }
+            }
+
+            node.lo[a] = std::uint16_t( lo );
+            node.hi[a] = std::uint16_t( hi );
+        }
+
+        return node;
+    }
+};
+
+#endif
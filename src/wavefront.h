@@ -0,0 +1,216 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "rtweekend.h"
+#include "color.h"
+#include "hittable.h"
+#include "material.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Breadth-first path tracer: instead of following one path to its end, it
+ * keeps a batch of paths in flight and advances all of them one bounce at a
+ * time.  Every bounce runs
+ *
+ *     intersect -> sort by material -> shade -> compact
+ *
+ * The sort moves the live paths' state itself into material order, so each
+ * material's «scatter» runs over a contiguous run of every array.
+ */
+class wavefront_integrator
+{
+public:
+    void clear( void )
+    {
+        orig_x.clear(); orig_y.clear(); orig_z.clear();
+        dir_x.clear();  dir_y.clear();  dir_z.clear();
+        throughput.clear();
+        slots.clear();
+        gens.clear();
+    }
+
+    /* Queue a path starting with «r»; its radiance will go to «slot» */
+    void add_path( const ray& r, const sampler& gen, std::uint32_t slot )
+    {
+        orig_x.push_back( r.origin().x() );
+        orig_y.push_back( r.origin().y() );
+        orig_z.push_back( r.origin().z() );
+        dir_x.push_back( r.direction().x() );
+        dir_y.push_back( r.direction().y() );
+        dir_z.push_back( r.direction().z() );
+        throughput.push_back( color( 1, 1, 1 ) );
+        slots.push_back( slot );
+        gens.push_back( gen );
+    }
+
+    size_t size( void ) const { return slots.size(); }
+
+    /*
+     * Trace every queued path for at most «max_depth» bounces, adding the
+     * radiance of each to «radiance»[slot].  «background( r )» gives the
+     * radiance of a ray leaving the scene.  Scattering goes through
+     * «Materials»::scatter, as in «camera::render», and paths are culled by
+     * «survives_roulette» from bounce «roulette_depth» on.
+     */
+    template <typename Materials = material_set<>, typename World, typename Background>
+    void trace( const World& world, int max_depth, int roulette_depth, const Background& background,
+                std::vector<color>& radiance )
+    {
+        for ( int depth = max_depth; depth > 0 && size() > 0; --depth ) {
+            int bounce = max_depth - depth;
+
+            intersect( world, background, radiance, bounce );
+            sort_by_material();
+            shade<Materials>( bounce, roulette_depth );
+            compact();
+        }
+
+        /* Paths still alive ran out of bounces and contribute nothing */
+        RTW_STAT( stats::local().path_lengths[stats_counters::bounce_bucket( max_depth )] += size() );
+        clear();
+    }
+
+private:
+    /* Path state, one entry per path in flight */
+    std::vector<double>        orig_x, orig_y, orig_z;
+    std::vector<double>        dir_x,  dir_y,  dir_z;
+    std::vector<color>         throughput;
+    std::vector<std::uint32_t> slots;
+    std::vector<sampler>       gens;
+
+    /* Per-bounce scratch */
+    std::vector<hit_record>    recs;
+    std::vector<std::uint8_t>  alive;
+    std::vector<std::uint32_t> starts;
+    std::vector<std::uint32_t> order;
+
+    /* Arrays the path state is sorted into, swapped with it afterwards */
+    std::vector<double>        sorted_reals;
+    std::vector<color>         sorted_colors;
+    std::vector<std::uint32_t> sorted_slots;
+    std::vector<sampler>       sorted_gens;
+    std::vector<hit_record>    sorted_recs;
+
+    ray path_ray( size_t i ) const
+    {
+        return ray( point3( orig_x[i], orig_y[i], orig_z[i] ), vec3( dir_x[i], dir_y[i], dir_z[i] ) );
+    }
+
+    template <typename World, typename Background>
+    void intersect( const World& world, const Background& background,
+                    std::vector<color>& radiance, [[maybe_unused]] int bounce )
+    {
+        recs.resize( size() );
+        alive.assign( size(), 1 );
+
+        RTW_STAT( stats::local().rays[stats_counters::bounce_bucket( bounce )] += size() );
+
+        for ( size_t i = 0; i < size(); ++i ) {
+            ray r = path_ray( i );
+
+            if ( ! world.hit( r, ray_interval, recs[i] ) ) {
+                radiance[slots[i]] += throughput[i] * background( r );
+                alive[i] = 0;
+                RTW_STAT( ++stats::local().path_lengths[stats_counters::bounce_bucket( bounce )] );
+            }
+        }
+    }
+
+    /*
+     * Counting sort of the live paths by «material::kind», which also drops
+     * the paths that left the scene: afterwards path i is the i-th live one
+     * in material order, with its hit in «recs»[i].
+     */
+    void sort_by_material( void )
+    {
+        starts.assign( material::kind_count + 1, 0 );
+        for ( size_t i = 0; i < size(); ++i ) {
+            if ( alive[i] ) { ++starts[recs[i].mat->kind + 1]; }
+        }
+        for ( size_t k = 1; k < starts.size(); ++k ) {
+            starts[k] += starts[k - 1];
+        }
+
+        order.resize( starts.back() );
+        for ( size_t i = 0; i < size(); ++i ) {
+            if ( alive[i] ) { order[starts[recs[i].mat->kind]++] = std::uint32_t( i ); }
+        }
+
+        gather( orig_x, sorted_reals ); gather( orig_y, sorted_reals ); gather( orig_z, sorted_reals );
+        gather( dir_x, sorted_reals );  gather( dir_y, sorted_reals );  gather( dir_z, sorted_reals );
+        gather( throughput, sorted_colors );
+        gather( slots, sorted_slots );
+        gather( gens, sorted_gens );
+        gather( recs, sorted_recs );
+
+        alive.assign( size(), 1 );
+    }
+
+    /* Replace «values» by its entries in «order», through «scratch» */
+    template <typename T>
+    void gather( std::vector<T>& values, std::vector<T>& scratch ) const
+    {
+        scratch.resize( order.size() );
+        for ( size_t i = 0; i < order.size(); ++i ) {
+            scratch[i] = values[order[i]];
+        }
+
+        values.swap( scratch );
+    }
+
+    template <typename Materials>
+    void shade( int bounce, int roulette_depth )
+    {
+        for ( size_t i = 0; i < size(); ++i ) {
+            ray   scattered;
+            color attenuation;
+
+            if ( Materials::scatter( *recs[i].mat, path_ray( i ), recs[i], attenuation, scattered, gens[i] ) ) {
+                throughput[i] = throughput[i] * attenuation;
+
+                if ( ! survives_roulette( throughput[i], roulette_depth, bounce + 1, gens[i] ) ) {
+                    alive[i] = 0;
+                    RTW_STAT( ++stats::local().path_lengths[stats_counters::bounce_bucket( bounce + 1 )] );
+                    continue;
+                }
+
+                orig_x[i] = scattered.origin().x();
+                orig_y[i] = scattered.origin().y();
+                orig_z[i] = scattered.origin().z();
+                dir_x[i]  = scattered.direction().x();
+                dir_y[i]  = scattered.direction().y();
+                dir_z[i]  = scattered.direction().z();
+            } else {
+                alive[i] = 0;
+                RTW_STAT( ++stats::local().path_lengths[stats_counters::bounce_bucket( bounce )] );
+            }
+        }
+    }
+
+    /* Drop the paths that ended while shading, keeping the survivors in order */
+    void compact( void )
+    {
+        size_t live = 0;
+
+        for ( size_t i = 0; i < size(); ++i ) {
+            if ( ! alive[i] ) { continue; }
+
+            orig_x[live] = orig_x[i]; orig_y[live] = orig_y[i]; orig_z[live] = orig_z[i];
+            dir_x[live]  = dir_x[i];  dir_y[live]  = dir_y[i];  dir_z[live]  = dir_z[i];
+            throughput[live] = throughput[i];
+            slots[live]      = slots[i];
+            gens[live]       = gens[i];
+            ++live;
+        }
+
+        orig_x.resize( live ); orig_y.resize( live ); orig_z.resize( live );
+        dir_x.resize( live );  dir_y.resize( live );  dir_z.resize( live );
+        throughput.resize( live );
+        slots.resize( live );
+        gens.resize( live );
+    }
+};
+
+#endif